@@ -0,0 +1,53 @@
+#!/bin/sh
+# bench.sh
+# ========
+# Times the html renderers of parse_theses.c (the fprintf writer it
+# replaced, the --template interpreter and the built-in per-format
+# writer) on a catalogue generated by make_fixture.sh. See
+# bench_render.c for what each renderer covers.
+#
+# Usage: sh bench.sh [COPIES] [RUNS]
+#
+# COPIES is passed to make_fixture.sh (default: 400) and RUNS is the
+# number of runs of each renderer (default: 5), of which the best is
+# reported. The compiler and flags can be set with CC and CFLAGS.
+
+cd "$(dirname "$0")" || exit 1
+
+CC=${CC:-cc}
+CFLAGS=${CFLAGS:--O2}
+COPIES=${1:-400}
+RUNS=${2:-5}
+TMP=$(mktemp -d)
+
+trap 'rm -rf "$TMP"' EXIT
+
+$CC $CFLAGS -o "$TMP/bench_render" bench_render.c -lpthread -lz || exit 1
+sh make_fixture.sh "$COPIES" >"$TMP/fixture.txt" || exit 1
+
+# Template reproducing the built-in entry layout, with an anchor for
+# each author initial in place of the jump link sections
+cat >"$TMP/entry.tmpl" <<'TMPL'
+<!-- *** BEGIN THESIS/DISSERTATION CONTENT HERE *** --!>
+<div align="center">
+
+{{#entries}}{{#new_initial}}  <a name={{initial}}></a>
+
+{{/new_initial}}  <a name=r{{id}}></a>
+  <table style="border:1px solid black; width:600px;">
+    <tr><td><b>Author:</b> {{author}}</td></tr>
+    <tr><td><b>Year:</b> {{year}}</td></tr>
+    <tr><td><b>Title:</b> {{title}}</td></tr>
+    <tr><td><b>Advisor:</b> {{advisor}}</td></tr>
+    <tr><td><b>Affiliation:</b> {{affiliation}}</td></tr>
+    <tr><td><b>Degree:</b> {{degree}}</td>{{#url}}<td align="right"><a href="{{url}}" target="_blank">URL</a></td>{{/url}}</tr>
+  </table><br>
+
+{{/entries}}  <center>Number of items: <b>{{count}}</b></center>
+  <center>({{ms}} MS | {{phd}} PhD)</center>
+
+</div>
+<!-- *** END THESIS/DISSERTATION CONTENT HERE *** --!>
+TMPL
+
+"$TMP/bench_render" --runs "$RUNS" "$TMP/entry.tmpl" "$TMP/fixture.txt"
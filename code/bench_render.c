@@ -0,0 +1,179 @@
+/* bench_render.c
+   ==============
+   This program times the html renderers of parse_theses.c on the same
+   sorted entries, writing their output to /dev/null. It includes
+   parse_theses.c directly, so it always measures the current code, and
+   can be compiled with:
+
+        gcc -O2 -o bench_render bench_render.c -lpthread -lz
+
+   and then executed using:
+
+        ./bench_render entry.tmpl catalogue.txt
+
+   where entry.tmpl is a --template file reproducing the built-in entry
+   layout (bench.sh writes one, and a large catalogue made by
+   make_fixture.sh). Three renderers are timed, each over the whole
+   page:
+
+        fprintf      each entry table written with fprintf format
+                     strings, as write_entry() did before the
+                     per-format writers
+        template     write_template(), the interpreter for compiled
+                     user templates
+        builtin      write_html(), which copies literals of known
+                     length and the escaped fields into one buffer per
+                     entry
+
+   The best time of each is printed to stderr. The following option is
+   also available:
+
+        --runs N     number of times each renderer is run (default: 5)
+*/
+
+
+#define main parse_theses_main
+#include "parse_theses.c"
+#undef main
+
+/* Default number of runs of each renderer */
+#define NRUN 5
+
+void write_row_fprintf(FILE *fp, const char *label, const char *value);
+void write_entry_fprintf(FILE *fp, struct thesis *entry);
+int write_html_fprintf(struct thesis *entry, int num, int nbucket);
+double elapsed_ms(struct timespec *t0);
+
+
+int main(int argc, char *argv[]) {
+
+  struct thesis *entry;
+  struct timespec t0;
+  char *fname, *tmpl;
+  double best[3], ms;
+  int i, r, num=0, nrun=NRUN;
+
+  for (i=1; (i < argc) && (strncmp(argv[i], "--", 2) == 0); i++) {
+    if ((strcmp(argv[i], "--runs") == 0) && (i+1 < argc)) nrun = atoi(argv[++i]);
+    else {
+      fprintf(stderr, "Unknown option: %s\n", argv[i]);
+      return (-1);
+    }
+  }
+  if ((i+2 != argc) || (nrun < 1)) {
+    fprintf(stderr, "Usage: bench_render [--runs N] template catalogue\n");
+    return (-1);
+  }
+  tmpl = argv[i];
+  fname = argv[i+1];
+
+  /* Read and sort the entries once, outside the timed runs */
+  entry = read_files(&fname, 1, NULL, &num, NULL, NULL);
+  if (num == -1) return (-1);
+  qsort(entry, num, sizeof(struct thesis), compare);
+
+  if (freopen("/dev/null", "w", stdout) == NULL) {
+    fprintf(stderr, "Failed to open /dev/null\n");
+    return (-1);
+  }
+
+  for (i=0; i<3; i++) best[i] = -1;
+  for (r=0; r<nrun; r++) {
+    for (i=0; i<3; i++) {
+      clock_gettime(CLOCK_MONOTONIC, &t0);
+      if (i == 0) write_html_fprintf(entry, num, NBUCKET);
+      else if ((i == 1) && (write_template(entry, num, tmpl) == -1)) return (-1);
+      else if (i == 2) write_html(entry, num, NBUCKET);
+      fflush(stdout);
+      ms = elapsed_ms(&t0);
+      if ((best[i] < 0) || (ms < best[i])) best[i] = ms;
+    }
+  }
+
+  fprintf(stderr, "%d entries, best of %d runs\n", num, nrun);
+  fprintf(stderr, "  fprintf   %8.1f ms\n", best[0]);
+  fprintf(stderr, "  template  %8.1f ms\n", best[1]);
+  fprintf(stderr, "  builtin   %8.1f ms  (%.2fx template, %.2fx fprintf)\n",
+          best[2], best[1]/best[2], best[0]/best[2]);
+
+  free(entry);
+
+  return(0);
+}
+
+
+/* Function to write one labelled row of a thesis/dissertation table */
+void write_row_fprintf(FILE *fp, const char *label, const char *value) {
+  fprintf(fp, "    <tr><td><b>%s:</b> ", label);
+  write_escaped(fp, value);
+  fprintf(fp, "</td></tr>\n");
+}
+
+
+/* Function to write the html table for one thesis/dissertation with
+ * format strings, as it was written before write_entry() */
+void write_entry_fprintf(FILE *fp, struct thesis *entry) {
+
+  fprintf(fp, "  <a name=r%016llx></a>\n", (unsigned long long)entry->id);
+  fprintf(fp, "  <table style=\"border:1px solid black; width:600px;\">\n");
+  write_row_fprintf(fp, "Author", entry->author);
+  write_row_fprintf(fp, "Year", entry->year);
+  write_row_fprintf(fp, "Title", entry->title);
+  write_row_fprintf(fp, "Advisor", entry->advisor);
+  write_row_fprintf(fp, "Affiliation", entry->affiliation);
+  fprintf(fp, "    <tr><td><b>Degree:</b> ");
+  write_escaped(fp, entry->degree);
+  fprintf(fp, "</td>");
+  if (entry->url[0] == '\0') {
+    fprintf(fp,"</tr>\n");
+  } else {
+    fprintf(fp, "<td align=\"right\"><a href=\"");
+    write_escaped(fp, entry->url);
+    fprintf(fp, "\" target=\"_blank\">URL</a></td></tr>\n");
+  }
+  fprintf(fp, "  </table><br>\n\n");
+}
+
+
+/* Function to build the same html as write_html() through
+ * write_entry_fprintf() */
+int write_html_fprintf(struct thesis *entry, int num, int nbucket) {
+
+  int i, j=0;
+  int ms_cnt=0, phd_cnt=0;
+  int hist[NLETTER], start[NLETTER], slot;
+  char alph[NLETTER][8];
+
+  memset(hist, 0, sizeof(hist));
+  for (i=0; i<num; i++) {
+    slot = initial_slot(&entry[i]);
+    hist[(slot < 0) ? 0 : slot]++;
+  }
+  nbucket = make_buckets(hist, num, nbucket, start, alph);
+
+  write_header(stdout, nbucket, alph);
+  for (i=0; i<num; i++) {
+    if (strcmp(entry[i].degree, "MS") == 0) ms_cnt++;
+    else if (strcmp(entry[i].degree, "PhD") == 0) phd_cnt++;
+    slot = initial_slot(&entry[i]);
+    while ( (j < nbucket) && (slot >= start[j]) ) {
+      fprintf(stdout, "  <a name=%s></a>\n\n",alph[j]);
+      j++;
+    }
+    write_entry_fprintf(stdout, &entry[i]);
+  }
+  write_footer(stdout, num, ms_cnt, phd_cnt);
+
+  return(0);
+}
+
+
+/* Function to return the milliseconds since t0 */
+double elapsed_ms(struct timespec *t0) {
+
+  struct timespec t1;
+
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+
+  return (t1.tv_sec - t0->tv_sec)*1e3 + (t1.tv_nsec - t0->tv_nsec)/1e6;
+}
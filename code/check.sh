@@ -0,0 +1,102 @@
+#!/bin/sh
+# check.sh
+# ========
+# Builds the example programs and checks them against the catalogue.
+#
+# Usage: sh check.sh
+#
+# The compiler and flags can be set with CC and CFLAGS, for example
+# CFLAGS="-g -fsanitize=address" to catch memory errors. Each check
+# prints "ok" or "FAIL" followed by its name, and the script exits with
+# the number of failed checks.
+
+cd "$(dirname "$0")" || exit 1
+
+CC=${CC:-cc}
+CFLAGS=${CFLAGS:--O2 -Wall}
+CATALOGUE=../superdarn_theses.txt
+TMP=$(mktemp -d)
+PORT=${PORT:-18080}
+fail=0
+
+trap 'kill $server 2>/dev/null; rm -rf "$TMP"' EXIT
+
+check() {
+  if [ "$1" = 0 ]; then echo "ok   $2"; else echo "FAIL $2"; fail=$((fail+1)); fi
+}
+
+$CC $CFLAGS -o "$TMP/parse_theses" parse_theses.c -lpthread -lz || exit 1
+$CC $CFLAGS -o "$TMP/parse_theses_site" parse_theses_site.c -lpthread -lz || exit 1
+
+# The server must survive query values longer than its fields, and keep
+# answering afterwards
+"$TMP/parse_theses" --serve 127.0.0.1:$PORT $CATALOGUE 2>"$TMP/serve.log" &
+server=$!
+sleep 1
+long=$(awk 'BEGIN { while (n++ < 7000) printf "a" }')
+curl -s "http://127.0.0.1:$PORT/?q=$long&format=json" >"$TMP/long.json"
+grep -q '"total": 0' "$TMP/long.json"
+check $? "server answers a 7000-byte query"
+curl -s "http://127.0.0.1:$PORT/?q=radar&format=json" | grep -q '"author"'
+check $? "server still answers after a long query"
+kill $server 2>/dev/null
+wait $server 2>/dev/null
+server=
+
+# A compacted catalogue must still be in the catalogue format
+cp $CATALOGUE "$TMP/compact.txt"
+"$TMP/parse_theses" --compact "$TMP/compact.txt" &&
+  "$TMP/parse_theses" --validate "$TMP/compact.txt" 2>&1 |
+  grep -q 'Number of items: 251 (0 errors)'
+check $? "--compact output passes --validate"
+
+# Page labels must stay within their buffers for malformed UTF-8 names,
+# and be escaped in the pager
+printf 'A\303' >"$TMP/bad.txt"
+awk 'BEGIN { while (n++ < 64) printf "\200" }' >>"$TMP/bad.txt"
+printf ', X\n2010\nT\nA\nU, C\nMS\n\n<b>&, Z\n2011\nT\nA\nU, C\nMS\n\n' >>"$TMP/bad.txt"
+mkdir "$TMP/pages"
+"$TMP/parse_theses" --page-size 1 --output "$TMP/pages" "$TMP/bad.txt" &&
+  grep -q '>&lt;b</a>' "$TMP/pages/page-1.html"
+check $? "page labels of malformed names"
+
+# Presorted input rendered straight into a file must match the sorted
+# output, with the jump links moved into place
+"$TMP/parse_theses" --sorted "$TMP/compact.txt" >"$TMP/sorted.html" &&
+  "$TMP/parse_theses" "$TMP/compact.txt" | cmp -s - "$TMP/sorted.html"
+check $? "--sorted output written to a file"
+
+# The search index must come with a page that uses it
+"$TMP/parse_theses_site" --search-index --output "$TMP/site" $CATALOGUE 2>/dev/null &&
+  grep -q 'action="search.html"' "$TMP/site/index.html" &&
+  grep -q 'src="search.js"' "$TMP/site/search.html" &&
+  grep -q 'search.json' "$TMP/site/search.js"
+check $? "site search page"
+
+# The functions the other programs share with parse_theses.c must not
+# drift from it. Each is taken from its doc comment to its closing brace
+func() {
+  awk -v f="$2" '
+    /^\/\*/ { doc = ""; indoc = 1 }
+    indoc { doc = doc $0 "\n"; if ($0 ~ /\*\//) indoc = 0; next }
+    !body && $0 ~ ("^[a-z].*[ *]" f "\\(.*\\{$") { body = 1; printf "%s", doc }
+    body { print; if ($0 == "}") exit }
+    /^$/ { doc = "" }
+  ' "$1"
+}
+same=0
+for prog in year:"parse_text is_year assign_fields fold_char make_key make_id copy_escaped copy_hex write_entry" \
+            site:"parse_text is_year assign_fields fold_char make_key make_id compare write_escaped copy_escaped copy_hex write_entry write_json gz_thread gz_start gz_push gz_finish" \
+            lineage:"parse_text is_year assign_fields write_escaped"; do
+  for f in ${prog#*:}; do
+    func parse_theses.c $f >"$TMP/a.c"
+    func parse_theses_${prog%%:*}.c $f >"$TMP/b.c"
+    if [ ! -s "$TMP/a.c" ] || ! cmp -s "$TMP/a.c" "$TMP/b.c"; then
+      echo "     $f differs in parse_theses_${prog%%:*}.c"
+      same=1
+    fi
+  done
+done
+check $same "shared functions match parse_theses.c"
+
+exit $fail
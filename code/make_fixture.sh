@@ -0,0 +1,32 @@
+#!/bin/sh
+# make_fixture.sh
+# ===============
+# Writes a large catalogue for benchmarks to stdout: COPIES copies of
+# the SuperDARN catalogue (default: 400, about 100,000 entries), with
+# the copy number added to each author's surname so that every entry
+# stays distinct. The output depends only on COPIES and the catalogue,
+# so timings taken on it can be reproduced.
+#
+# Usage: sh make_fixture.sh [COPIES] > fixture.txt
+
+cd "$(dirname "$0")" || exit 1
+
+COPIES=${1:-400}
+
+awk -v copies="$COPIES" '
+  { line[n++] = $0 }
+  END {
+    for (c = 1; c <= copies; c++) {
+      first = 1
+      for (i = 0; i < n; i++) {
+        s = line[i]
+        if (s == "") first = 1
+        else if (first) {
+          sub(/,/, " " c ",", s)
+          first = 0
+        }
+        print s
+      }
+      if (line[n-1] != "") print ""
+    }
+  }' ../superdarn_theses.txt
@@ -9,21 +9,235 @@
    alphabetically by author last name first and then by year if
    necessary. The program can be compiled with:
 
-        gcc -o parse_theses parse_theses.c
+        gcc -o parse_theses parse_theses.c -lpthread -lz
 
    and then executed using:
 
         ./parse_theses superdarn_theses.txt > output.html
+
+   Several input files may be given, in which case their entries are
+   combined before sorting. Input files are read in large blocks on a
+   separate thread, overlapping with parsing, and those ending in .gz
+   are decompressed on that thread so the uncompressed text is never
+   written to disk. The following options are also available:
+
+        --dedupe     find near-duplicate entries (eg, the same thesis
+                     submitted in overlapping lists with small title or
+                     author variations), report them to stderr and merge
+                     them before building the html
+        --validate   check each entry for formatting errors and report
+                     them to stderr as file:line diagnostics, without
+                     building the html
+        --page-size N
+                     split the sorted entries into pages of N entries,
+                     written as page-1.html, page-2.html, ... with
+                     prev/next links and jump links labelled by the
+                     range of author names on each page
+        --buckets N  number of jump links on a single page (default: 4),
+                     chosen from the distribution of author initials so
+                     that each section holds a similar number of entries,
+                     plus an "Other" link to any names whose initials
+                     sort after Z (eg, Greek or Cyrillic)
+        --output DIR write pages to DIR (default: current directory)
+        --threads N  number of threads writing pages (default: number
+                     of online processors)
+        --sorted     the input is already in sorted order, so entries are
+                     rendered as they are parsed and the sort is skipped
+                     (falling back to a full sort if an entry is found
+                     out of order). When stdout is a file, entries are
+                     written to it directly and the jump links are
+                     inserted at the end; otherwise they are held in
+                     memory until the input has been read
+        --gzip       also write a gzip-compressed copy of every page
+                     (eg, page-1.html.gz) for web servers that serve
+                     pre-compressed content, compressed on a separate
+                     thread as the pages are written (only with
+                     --page-size)
+        --year A..B  keep only entries from years A to B (either may be
+                     left out, eg 2010.., or give a single year)
+        --degree D   keep only entries with degree D (eg, PhD)
+        --country C  keep only entries with an affiliation in country C
+        --institution I
+                     keep only entries with an affiliation at
+                     institution I. Text filters ignore case and must
+                     match the whole value, unless they start with ~
+                     to match any part of it (eg, ~Leicester). Filters
+                     are checked while parsing, so entries that do not
+                     match are never stored, sorted or rendered
+        --export FORMAT
+                     write every entry as a citation instead of html,
+                     where FORMAT is bibtex (@phdthesis/@mastersthesis
+                     chosen by degree), ris or csl-json, or as records
+                     in json (as answered by --serve) or csv. Each entry
+                     gets a unique citation key (eg, Thomas2012dynamics),
+                     and chunks of entries are written on --threads
+                     threads
+        --feed FORMAT
+                     write the --feed-size most recent entries (default:
+                     20) as an atom or rss feed instead of html, picking
+                     them out with a heap rather than sorting every entry
+        --feed-url URL
+                     link to the page the feed is for, also used as the
+                     id of an atom feed (required for rss). Entries
+                     without a URL link to their anchor on that page
+                     (eg, URL#r5116c47312006441)
+        --add, --edit, --delete
+                     append each entry read from stdin (in the same
+                     format as the input file) to the edit log as an
+                     addition, a replacement of the entry with the same
+                     author and year (of several, the one with the lowest
+                     ID), or a deletion of that entry, and exit without
+                     building the html. The edit log is applied
+                     whenever the input is read, so edits are seen
+                     without rewriting the input file
+        --log FILE   edit log to use (default: the first input file
+                     with .log appended)
+        --compact    fold the edit log into the input file, rewriting
+                     it in sorted order, and remove the log
+        --diff OLD   compare the input with an older version of it in the
+                     file OLD, writing an html fragment with the new and
+                     updated entries and a list of the removed ones
+                     instead of the full html, and reporting them to
+                     stderr. Entries are matched by author, year and
+                     title in linear time, so it can be run on every
+                     change to a large catalogue
+        --template FILE
+                     write the html through the template in FILE instead
+                     of the built-in layout. Templates are html with tags
+                     for fields, {{author}}, {{year}}, {{title}},
+                     {{advisor}}, {{affiliation}}, {{degree}}, {{url}},
+                     {{id}} and {{initial}} (the folded first letter of
+                     the author), which are only allowed inside an
+                     {{#entries}} ... {{/entries}} loop over the sorted
+                     entries, and the totals {{count}}, {{ms}} and
+                     {{phd}}. {{#field}} ... {{/field}} is only written
+                     if the field is not empty (or zero), and {{^field}}
+                     ... {{/field}} only if it is, where new_initial is
+                     also a field, set when the initial differs from the
+                     previous entry's (eg, for jump link anchors). The
+                     template is compiled once into a list of literal
+                     spans and field references, which are copied into a
+                     large output buffer for each entry
+        --serve [HOST]:PORT
+                     load the entries once and answer HTTP/1.1 queries
+                     on HOST (default: 127.0.0.1) and PORT instead of
+                     writing html, reloading the input files whenever
+                     they change and applying records added to the edit
+                     log to the index in place. See serve_dataset() for
+                     the queries
+
+   Each entry is given an ID hashed from its author, year and title,
+   which names an anchor before it in the html (eg, #r5116c47312006441)
+   for linking to it directly.
+
+   Near-duplicates are found by computing MinHash signatures of the
+   character shingles in each author and title, then grouping entries
+   whose signatures collide in any band of locality-sensitive hashing
+   (LSH) buckets, so that not every pair of entries has to be compared.
 */
 
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <zlib.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <signal.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
 
 #define STRLEN 512
 
+/* Fixed fragments of the output are written, or copied into a buffer,
+ * with their lengths known at compile time, so no format string is
+ * parsed for them */
+#define PUT_LIT(fp, s) fwrite_unlocked(s, 1, sizeof(s)-1, fp)
+#define CPY_LIT(p, s) (memcpy(p, s, sizeof(s)-1), (p) += sizeof(s)-1)
+
+/* Longest html table written for one entry: every field escaped to at
+ * most six times its length, plus the fixed fragments */
+#define ENTRYLEN (8*6*STRLEN)
+
+/* Length of the collation key of each entry, and of the part of it
+ * holding the folded author name */
+#define KEYLEN 64
+#define NAMEKEY 44
+
+/* MinHash signature length, split into LSH bands of rows each */
+#define NHASH 64
+#define BANDS 16
+#define ROWS (NHASH/BANDS)
+#define SHINGLE 3
+
+/* Minimum fraction of matching signature values for a duplicate */
+#define DEDUPE_THRESHOLD 0.6
+
+/* Default number of jump links on a single page */
+#define NBUCKET 4
+
+/* Author initials counted for the jump links: A to Z, and then one for
+ * every initial that sorts after Z */
+#define NLETTER 27
+
+/* Number and size of blocks in the input ring buffer */
+#define NBLOCK 4
+#define BLOCKSIZE (256*1024)
+
+/* Maximum number of written pages waiting to be compressed */
+#define GZQUEUE 64
+
+/* Connections waiting for a server thread, size of the request and of
+ * the response buffer owned by each server thread */
+#define CONNQUEUE 64
+#define REQLEN 8192
+#define RESPBUF (64*1024)
+
+/* Maximum number of levels in each skip list of the record index */
+#define MAXLEVEL 24
+
+/* Header row of the csv export */
+#define CSVHEADER "id,author,year,title,advisor,affiliation,degree,url\r\n"
+
+/* Length of a citation key and number of entries exported by each
+ * thread at a time */
+#define CITELEN 64
+#define CHUNKSIZE 1024
+
+/* Default number of entries in a feed */
+#define FEEDSIZE 20
+
+/* Deepest nesting of template sections, and size of the buffer the
+ * template output is copied into */
+#define TMPLDEPTH 32
+#define OUTBUF (256*1024)
+
+/* Length of the header of each edit log record */
+#define LOGHEADER 12
+
+/* Number of lines in each entry, including the blank separator line */
+#define NFIELD 7
+#define NLINE 8
+
+/* Maximum number of lines kept for each entry */
+#define NSLOT 16
+
+/* Degree types counted in the html summary */
+char *degrees[] = {"MS", "PhD"};
+#define NDEGREE (sizeof(degrees)/sizeof(degrees[0]))
+
 struct thesis {
   char author[STRLEN];
   char year[STRLEN];
@@ -32,193 +246,4298 @@ struct thesis {
   char affiliation[STRLEN];
   char degree[STRLEN];
   char url[STRLEN];
+  unsigned char key[KEYLEN];
+  uint64_t id;
+};
+
+/* Finished pages waiting to be compressed */
+struct gzjob {
+  char path[2*STRLEN];
+  char *buf;
+  size_t size;
+};
+
+struct gzqueue {
+  struct gzjob job[GZQUEUE];
+  int head, count, done, errors;
+  pthread_mutex_t lock;
+  pthread_cond_t ready, space;
+  pthread_t thread;
+};
+
+/* Reader thread feeding an input file to the parser in blocks */
+struct reader {
+  int fd;
+  gzFile gz;
+  char *block[NBLOCK];
+  size_t len[NBLOCK];
+  size_t pos;
+  atomic_uint head, tail;
+  atomic_int stop;
+  int status;
+  pthread_t thread;
+};
+
+/* Formatting error found by --validate, reported in line order */
+struct diag {
+  int lineno, order;
+  const char *msg, *line;
+};
+
+/* Filters given on the command line, checked in order of increasing
+ * cost against each entry as it is parsed */
+enum { YEAR_RANGE, DEGREE, COUNTRY, INSTITUTION };
+
+struct filter {
+  int field, cost;
+  int lo, hi;
+  int substr;
+  char value[STRLEN];
+  struct filter *next;
+};
+
+/* Html rendered while parsing input that is already in sorted order,
+ * written straight to stdout from offset base if it is a file (which is
+ * reopened as fd to read it back) or to a buffer otherwise */
+struct stream {
+  FILE *body;
+  char *buf;
+  size_t size;
+  long base;
+  int fd;
+  struct thesis prev;
+  int cnt, sorted;
+  int hist[NLETTER], maxletter;
+  long off[NLETTER];
+  int ms_cnt, phd_cnt;
+};
+
+/* Filters and stream renderer that keep_entry() applies to each entry
+ * as it is parsed */
+struct keep {
+  struct filter *fl;
+  struct stream *st;
+};
+
+/* Orders kept by the record index */
+enum { BYAUTHOR, BYYEAR };
+
+/* Entry held in the record index, linked into a skip list for each
+ * order with height[order] levels */
+struct node {
+  struct thesis t;
+  int height[2];
+  struct node **next[2];
+  struct node *link[];
+};
+
+/* Record index keeping entries in author order (by collation key) and
+ * in year order (newest first, then by collation key), so that entries
+ * are inserted, deleted and found in O(log n) without re-sorting */
+struct index {
+  struct node *head;
+  int level[2];
+  int num;
+  uint32_t seed;
+};
+
+/* Indexed entries loaded by the server, freed once the last request
+ * using them has finished after a reload */
+struct dataset {
+  struct index *ix;
+  int refs;
+  pthread_rwlock_t rw;
+};
+
+/* Server state shared by the accepting and answering threads */
+struct server {
+  char **fname;
+  const char *logname;
+  int nfile, dedup;
+  struct filter *filter;
+  long long mtime;
+  off_t logoff;
+  struct dataset *data;
+  int conn[CONNQUEUE];
+  int head, count, done;
+  pthread_mutex_t lock;
+  pthread_cond_t ready, space;
+};
+
+/* Filters, order and format parsed from a query string */
+struct query {
+  char q[STRLEN], year[STRLEN], degree[STRLEN];
+  char advisor[STRLEN], affiliation[STRLEN];
+  char field[STRLEN], sort[STRLEN], format[STRLEN];
+  int offset, limit;
+};
+
+/* Citation formats written by --export, and the chunks of entries
+ * shared by the threads writing them */
+enum { BIBTEX, RIS, CSLJSON, JSON, CSV };
+
+struct export {
+  struct thesis *entry;
+  int num, format, nchunk;
+  char (*cite)[CITELEN];
+  char **buf;
+  size_t *size;
+
+  pthread_mutex_t lock;
+  int next, errors;
+};
+
+/* Entry held in the heap of most recent entries for a feed, with its
+ * year as an integer */
+struct recent {
+  int year;
+  struct thesis *t;
+};
+
+/* Instructions of a compiled template: a literal span, a field of the
+ * current entry or a total, and the start of an {{#entries}} loop or
+ * of a section written only if a field is set or unset, whose end is
+ * at instruction jump */
+enum { T_TEXT, T_FIELD, T_LOOP, T_IF, T_UNLESS, T_END };
+
+struct tmpl_op {
+  int code;
+  int arg, jump;
+  const char *text;
+  size_t len;
+};
+
+struct tmpl {
+  char *src;
+  struct tmpl_op *op;
+  int nop;
+};
+
+/* Fields a template may refer to, the first seven being the fields of
+ * struct thesis in order */
+char *tmpl_fields[] = {"author", "year", "title", "advisor", "affiliation", "degree", "url",
+                       "id", "initial", "new_initial", "count", "ms", "phd"};
+enum { F_ID=7, F_INITIAL, F_NEWINITIAL, F_COUNT, F_MS, F_PHD, NTMPLFIELD, F_ENTRIES };
+
+/* Buffer the template output is copied into before it is written */
+struct outbuf {
+  FILE *fp;
+  size_t len;
+  char buf[OUTBUF];
 };
 
+/* Pages of sorted entries shared by the threads writing them */
+struct pages {
+  struct thesis *entry;
+  int num, pagesize, npage;
+  char (*label)[32];
+  char *outdir;
+  struct gzqueue *gz;
 
-struct thesis *parse_text(FILE *fp, int *num);
+  pthread_mutex_t lock;
+  int next, errors;
+};
+
+
+FILE *open_input(const char *fname);
+int close_input(FILE *fp);
+struct thesis *read_files(char **fname, int nfile, const char *logname, int *num,
+                          struct filter *fl, struct stream *st);
+int append_log(const char *logname, int op);
+void put_le32(unsigned char *p, uint32_t v);
+uint32_t get_le32(const unsigned char *p);
+int check_record(const unsigned char *rec, size_t avail);
+struct thesis *read_record(const unsigned char *rec);
+int find_record(struct thesis *entry, int *table, int size, struct thesis *t);
+int live_record(struct thesis *entry, const char *gone, const int *link, int i);
+int apply_log(const char *logname, struct thesis **entry, int num, struct filter *fl);
+int same_entry(struct thesis *t1, struct thesis *t2);
+void entry_fields(struct thesis *t, char **field);
+void write_text(FILE *fp, struct thesis *t);
+int compact_log(const char *fname, const char *logname, struct thesis *entry, int num);
+struct thesis *parse_text(FILE *fp, int *num, int (*keep)(struct thesis *, void *), void *arg);
+int keep_entry(struct thesis *t, void *arg);
+int add_filter(struct filter **chain, int field, const char *arg);
+int match_filter(struct filter *fl, struct thesis *t);
+int match_text(struct filter *f, const char *str, int len);
+int match_affiliation(struct filter *f, const char *affil);
+void stream_entry(struct stream *st, struct thesis *entry);
+int open_stream(struct stream *st);
+int write_stream(struct stream *st, int nbucket);
+int move_back(int fd, off_t from, off_t to, off_t len);
+int is_year(const char *line);
+void assign_fields(struct thesis *t, char **line, int n);
+int fold_char(const unsigned char **p, unsigned char *out);
+void make_key(struct thesis *t);
+void make_id(struct thesis *t);
+int compare_diag(const void *s1, const void *s2);
+void add_diag(struct diag *dg, int *nd, int lineno, const char *msg, const char *line);
+int check_entry(const char *fname, char **line, int *lineno, char *toolong, int n,
+                const char *next, int nextno);
+int validate_text(FILE *fp, const char *fname, int *num);
+int dedupe(struct thesis *entry, int num);
 int compare(const void *s1, const void *s2);
-int write_html(struct thesis *entry, int num);
+void write_escaped(FILE *fp, const char *str);
+char *copy_escaped(char *dst, const char *str);
+char *copy_hex(char *dst, uint64_t v);
+void write_hex(FILE *fp, uint64_t v);
+void write_entry(FILE *fp, struct thesis *entry);
+int fold_letter(const char *str);
+int initial_slot(struct thesis *t);
+int write_html(struct thesis *entry, int num, int nbucket);
+int write_pages(struct thesis *entry, int num, int pagesize, char *outdir, int nthread,
+                int gzip);
+int serve_dataset(const char *addr, char **fname, int nfile, const char *logname,
+                  int dedup, struct filter *fl, int nthread);
+struct dataset *load_dataset(struct server *sv);
+int update_dataset(struct server *sv, struct dataset *d);
+void release_dataset(struct server *sv, struct dataset *d);
+int compare_node(int order, struct node *n, const char *year, const unsigned char *key,
+                 const struct node *at);
+struct index *index_create(void);
+void index_search(struct index *ix, int order, const char *year, const unsigned char *key,
+                  const struct node *at, struct node **prev);
+int index_height(struct index *ix);
+struct node *index_insert(struct index *ix, const struct thesis *t);
+void index_delete(struct index *ix, struct node *n);
+struct node *index_seek(struct index *ix, int order, const char *year, const unsigned char *key);
+struct node *index_first(struct index *ix, int order);
+struct node *index_find(struct index *ix, const struct thesis *t);
+void index_free(struct index *ix);
+long long input_mtime(struct server *sv);
+void *serve_thread(void *arg);
+void answer_request(struct server *sv, int fd, char *iobuf);
+void parse_query(char *str, struct query *qry);
+int match_entry(struct thesis *t, struct query *qry);
+void write_list(FILE *fp, struct dataset *d, struct query *qry);
+void write_facets(FILE *fp, struct dataset *d, struct query *qry);
+int compare_string(const void *s1, const void *s2);
+void write_json(FILE *fp, const char *str);
+void write_json_entry(FILE *fp, struct thesis *t);
+void write_csv_field(FILE *fp, const char *str);
+void write_csv(FILE *fp, struct thesis *t);
+int make_cite_keys(struct thesis *entry, int num, char (*cite)[CITELEN]);
+void split_affiliation(const char *affil, char *school, char *place);
+void write_bibtex(FILE *fp, struct thesis *t, const char *cite);
+void put_bibtex(FILE *fp, const char *str);
+void put_bibfield(FILE *fp, const char *name, const char *pre, const char *value);
+void put_biburl(FILE *fp, const char *url);
+void put_ris(FILE *fp, const char *tag, const char *value);
+void put_csl(FILE *fp, const char *name, const char *value);
+void write_ris(FILE *fp, struct thesis *t, const char *cite);
+void write_csl(FILE *fp, struct thesis *t, const char *cite);
+void *export_thread(void *arg);
+int write_export(struct thesis *entry, int num, const char *format, int nthread);
+int compare_recent(const void *s1, const void *s2);
+void sift_recent(struct recent *heap, int n, int i);
+void write_date(FILE *fp, int year, int rss);
+int write_feed(struct thesis *entry, int num, const char *format, int size,
+               const char *link);
+uint64_t hash_record(struct thesis *t);
+int compare_ptr(const void *s1, const void *s2);
+int diff_entries(struct thesis *old, int nold, struct thesis *cur, int ncur);
+int compile_template(const char *fname, struct tmpl *tp);
+void put_out(struct outbuf *ob, const char *str, size_t n);
+void put_escaped(struct outbuf *ob, const char *str);
+const char *field_text(int f, struct thesis *t, struct thesis *prev, int *total, char *buf);
+void run_template(struct tmpl *tp, int start, int end, struct thesis *entry, int num,
+                  struct thesis *t, struct thesis *prev, int *total, struct outbuf *ob);
+int write_template(struct thesis *entry, int num, const char *fname);
+void *gz_thread(void *arg);
+int gz_start(struct gzqueue *q);
+void gz_push(struct gzqueue *q, const char *path, char *buf, size_t size);
+int gz_finish(struct gzqueue *q);
 
 
 int main(int argc, char *argv[]) {
 
-  char fname[STRLEN];
+  char *fname[argc+1];
   FILE *fp;
 
   struct thesis *entry=NULL;
-  int num=0;
+  int num=0, cnt;
 
-  /* Get input filename */
-  if (argc < 2) strcpy(fname, "superdarn_theses.txt");
-  else strcpy(fname, argv[1]);
+  struct stream st, *stream=NULL;
+  struct filter *filter=NULL;
 
-  /* Open input text file */
-  fp = fopen(fname, "r");
-  if (fp == NULL) {
-    fprintf(stderr, "File not found: %s\n", fname);
+  int i, nfile=0, dedup=0, validate=0, gzip=0, errors=0;
+  int pagesize=0, nbucket=NBUCKET, nthread, feedsize=FEEDSIZE;
+  char *outdir=".", *serve=NULL, *format=NULL, *feed=NULL, *feedurl="";
+  char logname[STRLEN+8], *log=NULL, *diff=NULL, *tmpl=NULL;
+  struct thesis *prior;
+  int edit=0, compact=0;
+
+  nthread = sysconf(_SC_NPROCESSORS_ONLN);
+
+  /* Get command line options and input filenames */
+  for (i=1; i<argc; i++) {
+    if (strcmp(argv[i], "--dedupe") == 0) dedup = 1;
+    else if (strcmp(argv[i], "--validate") == 0) validate = 1;
+    else if ((strcmp(argv[i], "--page-size") == 0) && (i+1 < argc)) pagesize = atoi(argv[++i]);
+    else if ((strcmp(argv[i], "--buckets") == 0) && (i+1 < argc)) nbucket = atoi(argv[++i]);
+    else if ((strcmp(argv[i], "--output") == 0) && (i+1 < argc)) outdir = argv[++i];
+    else if ((strcmp(argv[i], "--threads") == 0) && (i+1 < argc)) nthread = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--sorted") == 0) stream = &st;
+    else if (strcmp(argv[i], "--gzip") == 0) gzip = 1;
+    else if ((strcmp(argv[i], "--serve") == 0) && (i+1 < argc)) serve = argv[++i];
+    else if ((strcmp(argv[i], "--export") == 0) && (i+1 < argc)) format = argv[++i];
+    else if (strcmp(argv[i], "--add") == 0) edit = 'A';
+    else if (strcmp(argv[i], "--edit") == 0) edit = 'E';
+    else if (strcmp(argv[i], "--delete") == 0) edit = 'D';
+    else if ((strcmp(argv[i], "--log") == 0) && (i+1 < argc)) log = argv[++i];
+    else if (strcmp(argv[i], "--compact") == 0) compact = 1;
+    else if ((strcmp(argv[i], "--diff") == 0) && (i+1 < argc)) diff = argv[++i];
+    else if ((strcmp(argv[i], "--template") == 0) && (i+1 < argc)) tmpl = argv[++i];
+    else if ((strcmp(argv[i], "--feed") == 0) && (i+1 < argc)) feed = argv[++i];
+    else if ((strcmp(argv[i], "--feed-size") == 0) && (i+1 < argc)) feedsize = atoi(argv[++i]);
+    else if ((strcmp(argv[i], "--feed-url") == 0) && (i+1 < argc)) feedurl = argv[++i];
+    else if ((strcmp(argv[i], "--year") == 0) && (i+1 < argc)) {
+      if (add_filter(&filter, YEAR_RANGE, argv[++i]) == -1) return (-1);
+    } else if ((strcmp(argv[i], "--degree") == 0) && (i+1 < argc)) {
+      if (add_filter(&filter, DEGREE, argv[++i]) == -1) return (-1);
+    } else if ((strcmp(argv[i], "--country") == 0) && (i+1 < argc)) {
+      if (add_filter(&filter, COUNTRY, argv[++i]) == -1) return (-1);
+    } else if ((strcmp(argv[i], "--institution") == 0) && (i+1 < argc)) {
+      if (add_filter(&filter, INSTITUTION, argv[++i]) == -1) return (-1);
+    }
+    else if (strncmp(argv[i], "--", 2) == 0) {
+      fprintf(stderr, "Unknown option: %s\n", argv[i]);
+      return (-1);
+    } else fname[nfile++] = argv[i];
+  }
+  if (nfile == 0) fname[nfile++] = "superdarn_theses.txt";
+  if (nthread < 1) nthread = 1;
+
+  /* Record edits in the log kept next to the first input file */
+  if (log == NULL) snprintf(logname, sizeof(logname), "%s.log", fname[0]);
+  else snprintf(logname, sizeof(logname), "%s", log);
+  if (edit) return (append_log(logname, edit) == -1) ? -1 : 0;
+  if (compact && ((nfile > 1) || (filter != NULL) ||
+                  ((strlen(fname[0]) > 3) && (strcmp(fname[0]+strlen(fname[0])-3, ".gz") == 0)))) {
+    fprintf(stderr, "The edit log can only be compacted into a single uncompressed input file without filters.\n");
+    return (-1);
+  }
+  if (gzip && ((pagesize <= 0) || (format != NULL) || (tmpl != NULL))) {
+    fprintf(stderr, "--gzip only compresses the html pages written with --page-size.\n");
     return (-1);
   }
 
-  /* Parse input text file for information about each thesis/dissertation */
-  entry = parse_text(fp, &num);
+  /* Answer queries against the entries held in memory */
+  if (serve != NULL) return serve_dataset(serve, fname, nfile, logname, dedup, filter, nthread);
 
-  /* Close input text file */
-  fclose(fp);
+  /* Render entries of presorted input as they are parsed, unless they
+   * are first to be merged or split into pages */
+  if ((stream != NULL) && (dedup || validate || (pagesize > 0) || (format != NULL) ||
+                         (feed != NULL) || compact || (diff != NULL) ||
+                         (tmpl != NULL) || (access(logname, F_OK) == 0))) stream = NULL;
+  if ((stream != NULL) && (open_stream(&st) == -1)) stream = NULL;
 
-  /* Check for error when parsing input text file */
-  if (num == -1) {
-    fprintf(stderr, "Failed to parse input text file.\n");
-    return (-1);
+  /* Check each input text file for formatting errors */
+  if (validate) {
+    for (i=0; i<nfile; i++) {
+      fp = open_input(fname[i]);
+      if (fp == NULL) {
+        fprintf(stderr, "File not found: %s\n", fname[i]);
+        return (-1);
+      }
+      errors += validate_text(fp, fname[i], &cnt);
+      if (close_input(fp) == -1) {
+        fprintf(stderr, "Failed to decompress input file: %s\n", fname[i]);
+        errors++;
+      }
+      num += cnt;
+    }
+
+    /* Report validation summary */
+    fprintf(stderr, "Number of items: %d (%d errors)\n", num, errors);
+    return (errors == 0) ? 0 : -1;
+  }
+
+  /* Read each input text file */
+  entry = read_files(fname, nfile, logname, &num, filter, stream);
+  if (num == -1) return (-1);
+
+  /* Finish writing html already rendered from presorted input */
+  if (stream != NULL) {
+    cnt = write_stream(&st, nbucket);
+    if (cnt == -1) {
+      fprintf(stderr, "Failed to write output.\n");
+      return (-1);
+    }
+    if (cnt == 0) return (0);
+    fprintf(stderr, "Input is not in sorted order; sorting entries.\n");
+  }
+
+  /* Merge near-duplicate entries */
+  if (dedup) num = dedupe(entry, num);
+
+  /* Compare with the older version of the input */
+  if (diff != NULL) {
+    prior = read_files(&diff, 1, NULL, &cnt, filter, NULL);
+    if (cnt == -1) return (-1);
+    if (dedup) cnt = dedupe(prior, cnt);
+    return (diff_entries(prior, cnt, entry, num) == -1) ? -1 : 0;
   }
 
+  /* Write the most recent entries, which needs no full sort */
+  if (feed != NULL) return (write_feed(entry, num, feed, feedsize, feedurl) == -1) ? -1 : 0;
+
   /* Sort theses/dissertations first alphabetically by author last name and then by year
    * Note: this may not be necessary if the input text file was already sorted */
   qsort(entry, num, sizeof(struct thesis), compare);
 
-  /* Build html and write to stdout */
-  write_html(entry, num);
+  /* Rewrite the input file with the edits applied */
+  if (compact) return (compact_log(fname[0], logname, entry, num) == -1) ? -1 : 0;
+
+  /* Build html and write to stdout, or to separate pages, or write citations */
+  if (format != NULL) {
+    if (write_export(entry, num, format, nthread) == -1) return (-1);
+  } else if (tmpl != NULL) {
+    if (write_template(entry, num, tmpl) == -1) return (-1);
+  } else if (pagesize > 0) {
+    if (write_pages(entry, num, pagesize, outdir, nthread, gzip) == -1) return (-1);
+  } else {
+    write_html(entry, num, nbucket);
+  }
 
   return (0);
 }
 
 
-/* Function to parse a text file and store information about each
- * thesis/dissertation in the appropriate field of a structure and
- * return the number of entries found */
-struct thesis *parse_text(FILE *fp, int *num) {
+/* Function to parse each input text file and return their entries
+ * combined with the edit log applied, or set num to -1 after reporting
+ * an error */
+struct thesis *read_files(char **fname, int nfile, const char *logname, int *num,
+                          struct filter *fl, struct stream *st) {
 
-  struct thesis *entry=NULL;
-  char line[STRLEN];
-  int i=0, cnt=0;
+  struct thesis *entry=NULL, *part;
+  struct keep kp;
+  FILE *fp;
+  int i, cnt;
 
-  /* Read in each line of text file */
-  while (fgets(line, STRLEN, fp) != NULL) {
+  kp.fl = fl;
+  kp.st = st;
+  *num = 0;
+  for (i=0; i<nfile; i++) {
 
-    /* Trim \n at end of each line returned by fgets */
-    line[strcspn(line, "\r\n")] = 0;
+    /* Open input text file */
+    fp = open_input(fname[i]);
+    if (fp == NULL) {
+      fprintf(stderr, "File not found: %s\n", fname[i]);
+      break;
+    }
 
-    /* Assign each line of text file to appropriate field */
-    switch(i) {
-      case 0:
-        if (entry == NULL) entry = malloc(sizeof(struct thesis));
-        else               entry = realloc(entry,sizeof(struct thesis)*(cnt+1));
+    /* Parse input text file for information about each thesis/dissertation */
+    part = parse_text(fp, &cnt, keep_entry, &kp);
 
-        strcpy(entry[cnt].author, line);
-        break;
-      case 1:
-        strcpy(entry[cnt].year, line);
-        break;
-      case 2:
-        strcpy(entry[cnt].title, line);
-        break;
-      case 3:
-        strcpy(entry[cnt].advisor, line);
-        break;
-      case 4:
-        strcpy(entry[cnt].affiliation, line);
-        break;
-      case 5:
-        strcpy(entry[cnt].degree, line);
-        break;
-      case 6:
-        strcpy(entry[cnt].url, line);
-        cnt++;
-        break;
+    /* Close input text file */
+    if (close_input(fp) == -1) {
+      fprintf(stderr, "Failed to decompress input file: %s\n", fname[i]);
+      free(part);
+      break;
+    }
+
+    /* Check for error when parsing input text file */
+    if (cnt == -1) {
+      fprintf(stderr, "Failed to parse input text file.\n");
+      break;
     }
 
-    /* Advance to next field or reset to the beginning for a new entry */
-    i++;
-    if (i == 8) i=0;
+    /* Append entries to those from any previous input files */
+    if (entry == NULL) {
+      entry = part;
+    } else if (cnt > 0) {
+      entry = realloc(entry, sizeof(struct thesis)*(*num+cnt));
+      memcpy(entry+*num, part, sizeof(struct thesis)*cnt);
+      free(part);
+    }
+    *num += cnt;
   }
 
-  /* Return the number of thesis/dissertation entries read from file */
-  *num = cnt;
+  if (i < nfile) {
+    free(entry);
+    *num = -1;
+    return NULL;
+  }
+
+  /* Apply the edits made since the input files were written */
+  if (logname != NULL) {
+    *num = apply_log(logname, &entry, *num, fl);
+    if (*num == -1) {
+      fprintf(stderr, "Failed to apply edit log: %s\n", logname);
+      free(entry);
+      return NULL;
+    }
+  }
 
   return entry;
 }
 
 
-/* Function to sort theses/dissertations first by author last name
- * and then by year (for use with qsort) */
-int compare(const void *s1, const void *s2) {
-  struct thesis *t1 = (struct thesis *)s1;
-  struct thesis *t2 = (struct thesis *)s2;
-  char author1[STRLEN], author2[STRLEN];
+/* Function to wait for the other side of a ring buffer to move word
+ * on from val, spinning briefly before sleeping on a futex */
+void ring_wait(atomic_uint *word, unsigned int val, int *spin) {
+  if (++(*spin) < 64) return;
+  syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
+
+
+/* Function to wake the other side of a ring buffer if it is sleeping
+ * on word */
+void ring_wake(atomic_uint *word) {
+  syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+
+/* Function to fill the blocks of a ring buffer with large reads from an
+ * input file, decompressing it first if needed, until the end of the
+ * file or until the reader is closed (run on its own thread). A block
+ * of length zero marks the end of the input */
+void *read_thread(void *arg) {
+
+  struct reader *r = (struct reader *)arg;
+  unsigned int head, tail;
+  ssize_t n=0, len;
+  char *blk;
+  int spin, err;
+
+  for (tail=0; ; tail++) {
 
-  /* Make sure first letter in author field is capitalized */
-  strcpy(author1, t1->author);
-  strcpy(author2, t2->author);
-  author1[0] = toupper(author1[0]);
-  author2[0] = toupper(author2[0]);
+    /* Wait for the parser to free a block */
+    spin = 0;
+    while (tail - (head = atomic_load_explicit(&r->head, memory_order_acquire)) == NBLOCK) {
+      if (atomic_load_explicit(&r->stop, memory_order_relaxed)) return NULL;
+      ring_wait(&r->head, head, &spin);
+    }
+    if (atomic_load_explicit(&r->stop, memory_order_relaxed)) return NULL;
+
+    blk = r->block[tail % NBLOCK];
+    for (len=0; len<BLOCKSIZE; len+=n) {
+      if (r->gz != NULL) n = gzread(r->gz, blk+len, BLOCKSIZE-len);
+      else n = read(r->fd, blk+len, BLOCKSIZE-len);
+      if (n <= 0) break;
+    }
+
+    /* A truncated gzip file reads as a short file but leaves an error set */
+    if ((n == 0) && (r->gz != NULL)) {
+      gzerror(r->gz, &err);
+      if (err != Z_OK) n = -1;
+    }
+    if (n < 0) r->status = -1;
+
+    r->len[tail % NBLOCK] = len;
+    atomic_store_explicit(&r->tail, tail+1, memory_order_release);
+    ring_wake(&r->tail);
+
+    /* Follow the last data block with an end marker */
+    if ((n <= 0) && (len > 0)) continue;
+    if (n <= 0) break;
+  }
+
+  return NULL;
+}
+
+
+/* Function to copy data from the ring buffer to stdio (fopencookie read) */
+ssize_t ring_read(void *cookie, char *buf, size_t size) {
+
+  struct reader *r = (struct reader *)cookie;
+  unsigned int head = atomic_load_explicit(&r->head, memory_order_relaxed);
+  size_t n, blk = head % NBLOCK;
+  int spin=0;
+
+  /* Wait for the reader thread to fill a block */
+  while (atomic_load_explicit(&r->tail, memory_order_acquire) == head) ring_wait(&r->tail, head, &spin);
+  if (r->len[blk] == 0) return 0;
+
+  n = r->len[blk] - r->pos;
+  if (n > size) n = size;
+  memcpy(buf, r->block[blk]+r->pos, n);
+  r->pos += n;
+
+  /* Hand the block back to the reader thread once it has been used */
+  if (r->pos == r->len[blk]) {
+    r->pos = 0;
+    atomic_store_explicit(&r->head, head+1, memory_order_release);
+    ring_wake(&r->head);
+  }
+
+  return n;
+}
+
+
+/* Function to stop the reader thread and release the ring buffer
+ * (fopencookie close), returning -1 if the input could not be read */
+int ring_close(void *cookie) {
+
+  struct reader *r = (struct reader *)cookie;
+  int i, status;
+
+  /* Moving head on as well stops the reader thread from going back to
+   * sleep between checking the flag and waiting on head */
+  atomic_store(&r->stop, 1);
+  atomic_fetch_add(&r->head, 1);
+  ring_wake(&r->head);
+  pthread_join(r->thread, NULL);
+
+  if (r->gz != NULL) gzclose(r->gz);
+  else close(r->fd);
+  for (i=0; i<NBLOCK; i++) free(r->block[i]);
+  status = r->status;
+  free(r);
 
-  int authorcompare = strcmp(author1, author2);
+  return status;
+}
+
+
+/* Function to open an input text file for reading. The file is read in
+ * large blocks on a separate thread (decompressing it first if its name
+ * ends in .gz), which hands them to the parser through a lock-free
+ * single-producer single-consumer ring buffer */
+FILE *open_input(const char *fname) {
+
+  cookie_io_functions_t io = {ring_read, NULL, NULL, ring_close};
+  struct reader *r;
+  size_t len = strlen(fname);
+  FILE *fp;
+  int i;
+
+  r = calloc(1, sizeof(struct reader));
+  if (r == NULL) return NULL;
+  r->fd = -1;
 
-  if (authorcompare == 0) {
-    if (t1->year < t2->year) return -1;
-    else if (t1->year > t2->year) return +1;
-    else return 0;
+  if ((len >= 3) && (strcmp(fname+len-3, ".gz") == 0)) {
+    r->gz = gzopen(fname, "rb");
+    if (r->gz != NULL) gzbuffer(r->gz, 131072);
   } else {
-    return authorcompare;
+    r->fd = open(fname, O_RDONLY);
+  }
+  if ((r->gz == NULL) && (r->fd == -1)) {
+    free(r);
+    return NULL;
+  }
+
+  for (i=0; i<NBLOCK; i++) {
+    r->block[i] = malloc(BLOCKSIZE);
+    if (r->block[i] == NULL) break;
+  }
+  atomic_init(&r->head, 0);
+  atomic_init(&r->tail, 0);
+  atomic_init(&r->stop, 0);
+
+  if ((i < NBLOCK) || (pthread_create(&r->thread, NULL, read_thread, r) != 0)) {
+    if (r->gz != NULL) gzclose(r->gz);
+    else close(r->fd);
+    while (i > 0) free(r->block[--i]);
+    free(r);
+    return NULL;
   }
+
+  fp = fopencookie(r, "r", io);
+  if (fp == NULL) ring_close(r);
+
+  return fp;
 }
 
 
-/* Function to build the thesis/dissertation html and
- * write it to stdout */
-int write_html(struct thesis *entry, int num) {
+/* Function to close an input text file and return -1 if it could not be
+ * read or decompressed */
+int close_input(FILE *fp) {
+  return (fclose(fp) == 0) ? 0 : -1;
+}
 
-  int i, j=0;
-  int ms_cnt=0, phd_cnt=0;
-  char *alph[4] = {"A-G", "H-N", "O-U", "V-Z"};
 
-  /* Start writing html output to stdout */
-  fprintf(stdout, "<!-- *** BEGIN THESIS/DISSERTATION CONTENT HERE *** --!>\n");
-  fprintf(stdout, "<div align=\"center\">\n\n");
+/* Function to append each entry read from stdin to the edit log as an
+ * add, edit or delete record, returning the number of records written
+ * or -1 on error. Each record is written with a single write() and
+ * flushed to disk before the next, so a crash can only leave a partial
+ * record at the end of the log */
+int append_log(const char *logname, int op) {
 
-  /* Build alphabetical links */
-  fprintf(stdout, "  <b>Jump to:</b>&nbsp;\n");
-  for (i=0; i<3; i++) {
-    fprintf(stdout, "  <a href=\"#%s\">%s</a>&nbsp;|\n",alph[i],alph[i]);
+  struct thesis *entry;
+  unsigned char *rec;
+  char *text;
+  size_t size;
+  uint32_t crc, len;
+  FILE *fp;
+  int i, fd, num;
+
+  entry = parse_text(stdin, &num, keep_entry, NULL);
+  if (num == -1) {
+    fprintf(stderr, "Failed to parse entries from stdin.\n");
+    return -1;
+  }
+  if (num == 0) {
+    fprintf(stderr, "No entries found on stdin.\n");
+    return -1;
+  }
+
+  fd = open(logname, O_WRONLY | O_APPEND | O_CREAT, 0644);
+  if (fd < 0) {
+    fprintf(stderr, "Failed to open edit log: %s\n", logname);
+    free(entry);
+    return -1;
   }
-  fprintf(stdout, "  <a href=\"#%s\">%s</a>\n\n",alph[i],alph[i]);
-  fprintf(stdout, "  <br><br>\n\n");
 
-  /* Step through each thesis/dissertation */
   for (i=0; i<num; i++) {
 
-    /* Count number of theses/dissertations by degree type */
-    if (strcmp(entry[i].degree, "MS") == 0) ms_cnt++;
-    else if (strcmp(entry[i].degree, "PhD") == 0) phd_cnt++;
+    /* Record header: "LOG" and the operation, the payload length and
+     * the CRC-32 of the operation and payload, little-endian */
+    fp = open_memstream(&text, &size);
+    if (fp == NULL) break;
+    fwrite("LOG", 1, 3, fp);
+    fputc(op, fp);
+    fwrite("\0\0\0\0\0\0\0\0", 1, 8, fp);
+    write_text(fp, &entry[i]);
+    fclose(fp);
 
-    /* Insert alphabetical links where necessary */
-    if ( (j < 4) && (toupper(entry[i].author[0]) >= alph[j][0]) ) {
-      fprintf(stdout, "  <a name=%s></a>\n\n",alph[j]);
-      j++;
+    rec = (unsigned char *)text;
+    len = size - LOGHEADER;
+    crc = crc32(crc32(0L, Z_NULL, 0), rec+3, 1);
+    crc = crc32(crc, rec+LOGHEADER, len);
+    put_le32(rec+4, len);
+    put_le32(rec+8, crc);
+
+    if ((write(fd, rec, size) != (ssize_t)size) || (fsync(fd) != 0)) {
+      free(text);
+      break;
     }
-  
-    /* Build html table for each thesis/dissertation */
-    fprintf(stdout, "  <table style=\"border:1px solid black; width:600px;\">\n");
-    fprintf(stdout, "    <tr><td><b>Author:</b> %s</td></tr>\n", entry[i].author);
-    fprintf(stdout, "    <tr><td><b>Year:</b> %s</td></tr>\n", entry[i].year);
-    fprintf(stdout, "    <tr><td><b>Title:</b> %s</td></tr>\n", entry[i].title);
-    fprintf(stdout, "    <tr><td><b>Advisor:</b> %s</td></tr>\n", entry[i].advisor);
-    fprintf(stdout, "    <tr><td><b>Affiliation:</b> %s</td></tr>\n", entry[i].affiliation);
-    fprintf(stdout, "    <tr><td><b>Degree:</b> %s</td>", entry[i].degree);
-    if (entry[i].url[0] == '\0') {
-      fprintf(stdout,"</tr>\n");
+    free(text);
+  }
+  close(fd);
+  free(entry);
+
+  if (i < num) {
+    fprintf(stderr, "Failed to write edit log: %s\n", logname);
+    return -1;
+  }
+
+  return num;
+}
+
+
+/* Function to store and load 32-bit little-endian values in the log */
+void put_le32(unsigned char *p, uint32_t v) {
+  p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+}
+
+uint32_t get_le32(const unsigned char *p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+
+/* Function to check that a complete, undamaged record starts at rec,
+ * with avail bytes of the log left from there */
+int check_record(const unsigned char *rec, size_t avail) {
+
+  size_t len;
+
+  if (avail < LOGHEADER) return 0;
+  len = get_le32(rec+4);
+
+  return (memcmp(rec, "LOG", 3) == 0) && (len <= avail-LOGHEADER) &&
+         (memchr("AED", rec[3], 3) != NULL) &&
+         (crc32(crc32(crc32(0L, Z_NULL, 0), rec+3, 1), rec+LOGHEADER, len) == get_le32(rec+8));
+}
+
+
+/* Function to parse the entry held by a record, returning NULL unless it
+ * holds exactly one */
+struct thesis *read_record(const unsigned char *rec) {
+
+  struct thesis *t;
+  FILE *fp;
+  int cnt;
+
+  fp = fmemopen((void *)(rec+LOGHEADER), get_le32(rec+4), "r");
+  if (fp == NULL) return NULL;
+  t = parse_text(fp, &cnt, keep_entry, NULL);
+  fclose(fp);
+  if (cnt != 1) {
+    free(t);
+    return NULL;
+  }
+
+  return t;
+}
+
+
+/* Function to find the slot of the hash table holding the entries with
+ * the same author and year as t, or the empty slot where they would go */
+int find_record(struct thesis *entry, int *table, int size, struct thesis *t) {
+
+  const unsigned char *p;
+  uint32_t h = 2166136261u;
+  int j;
+
+  for (p=(const unsigned char *)t->author; *p != '\0'; p++) h = (h ^ *p) * 16777619u;
+  h = (h ^ '\n') * 16777619u;
+  for (p=(const unsigned char *)t->year; *p != '\0'; p++) h = (h ^ *p) * 16777619u;
+
+  for (j=h & (size-1); table[j] != -1; j=(j+1) & (size-1)) {
+    if ((strcmp(entry[table[j]].author, t->author) == 0) &&
+        (strcmp(entry[table[j]].year, t->year) == 0)) break;
+  }
+
+  return j;
+}
+
+
+/* Function to return the entry a record with the author and year of
+ * the chain of entries starting at i applies to: the one not yet
+ * deleted with the lowest ID, as index_find() chooses, or -1 if every
+ * entry in the chain is deleted */
+int live_record(struct thesis *entry, const char *gone, const int *link, int i) {
+
+  int best=-1;
+
+  for (; i != -1; i=link[i]) {
+    if (gone[i]) continue;
+    if ((best == -1) || (entry[i].id <= entry[best].id)) best = i;
+  }
+
+  return best;
+}
+
+
+/* Function to apply the records of the edit log to the entries read from
+ * the input files, matching entries by author and year, and return the
+ * new number of entries (or -1 on error). Where several entries share
+ * an author and year, a record applies to the one with the lowest ID,
+ * as for the server's index. Reading stops at the first damaged record,
+ * such as one left partly written by a crash */
+int apply_log(const char *logname, struct thesis **entry, int num, struct filter *fl) {
+
+  struct thesis *e = *entry, *t;
+  struct stat sb;
+  unsigned char *log;
+  char *gone;
+  size_t off, len;
+  int fd, i, j, nrec=0, nadd=0, size, *table, *link;
+
+  fd = open(logname, O_RDONLY);
+  if (fd < 0) return num;
+  if ((fstat(fd, &sb) != 0) || ((log = malloc(sb.st_size+1)) == NULL)) {
+    close(fd);
+    return -1;
+  }
+  for (off=0; off<(size_t)sb.st_size; off+=len) {
+    len = read(fd, log+off, sb.st_size-off);
+    if ((ssize_t)len <= 0) break;
+  }
+  close(fd);
+  if (off < (size_t)sb.st_size) {
+    fprintf(stderr, "Failed to read edit log: %s\n", logname);
+    free(log);
+    return -1;
+  }
+
+  /* Check each record, counting those that may add an entry */
+  for (off=0; off<(size_t)sb.st_size; off+=LOGHEADER+len) {
+    if (!check_record(log+off, sb.st_size-off)) break;
+    len = get_le32(log+off+4);
+    if (log[off+3] != 'D') nadd++;
+    nrec++;
+  }
+  if (off < (size_t)sb.st_size) {
+    fprintf(stderr, "%s: ignoring damaged record at byte %zu\n", logname, off);
+  }
+
+  e = realloc(e, sizeof(struct thesis)*(num+nadd+1));
+  gone = calloc(num+nadd+1, 1);
+  for (size=16; size < 2*(num+nadd); size*=2);
+  table = malloc(sizeof(int)*size);
+  link = malloc(sizeof(int)*(num+nadd+1));
+  if ((e == NULL) || (gone == NULL) || (table == NULL) || (link == NULL)) {
+    if (e != NULL) *entry = e;
+    free(log);
+    free(gone);
+    free(table);
+    free(link);
+    return -1;
+  }
+  *entry = e;
+
+  /* Chain the entries with the same author and year from the slot of
+   * the hash table holding them */
+  for (i=0; i<size; i++) table[i] = -1;
+  for (i=0; i<num; i++) {
+    j = find_record(e, table, size, &e[i]);
+    link[i] = table[j];
+    table[j] = i;
+  }
+
+  /* Apply the records in order, each holding a single entry as text */
+  for (off=0; nrec>0; nrec--, off+=LOGHEADER+len) {
+    len = get_le32(log+off+4);
+    t = read_record(log+off);
+    if (t == NULL) continue;
+
+    j = find_record(e, table, size, t);
+    i = live_record(e, gone, link, table[j]);
+
+    if (log[off+3] == 'D') {
+      if (i != -1) gone[i] = 1;
+      else if (fl == NULL) fprintf(stderr, "%s: no entry to delete: %s (%s)\n", logname, t->author, t->year);
+    } else if ((i != -1) && (log[off+3] == 'A') && same_entry(&e[i], t)) {
+      /* Already added, eg by compaction interrupted before the log
+       * was removed */
     } else {
-      fprintf(stdout, "<td align=\"right\"><a href=\"%s\" target=\"_blank\">URL</a></td></tr>\n", entry[i].url);
+      if ((i == -1) && (log[off+3] == 'E') && (fl == NULL))
+        fprintf(stderr, "%s: no entry to edit, adding: %s (%s)\n", logname, t->author, t->year);
+      if ((i == -1) || (log[off+3] == 'A')) {
+        i = num++;
+        link[i] = table[j];
+        table[j] = i;
+      }
+      e[i] = *t;
+      gone[i] = !match_filter(fl, &e[i]);
     }
-    fprintf(stdout, "  </table><br>\n\n");
+    free(t);
   }
 
-  /* Print total number of items at bottom of page */
-  fprintf(stdout, "  <center>Number of items: <b>%d</b></center>\n", num);
-  fprintf(stdout, "  <center>(%d MS | %d PhD)</center>\n\n",ms_cnt,phd_cnt);
+  /* Drop deleted entries */
+  for (i=j=0; i<num; i++) {
+    if (gone[i]) continue;
+    if (i != j) e[j] = e[i];
+    j++;
+  }
 
-  /* Finish writing html output to stdout */
-  fprintf(stdout, "</div>\n");
-  fprintf(stdout, "<!-- *** END THESIS/DISSERTATION CONTENT HERE *** --!>\n");
+  free(log);
+  free(gone);
+  free(table);
+  free(link);
 
-  return(0);
+  return j;
+}
+
+
+/* Function to check whether two entries have the same fields */
+int same_entry(struct thesis *t1, struct thesis *t2) {
+
+  return (strcmp(t1->author, t2->author) == 0) && (strcmp(t1->year, t2->year) == 0) &&
+         (strcmp(t1->title, t2->title) == 0) && (strcmp(t1->advisor, t2->advisor) == 0) &&
+         (strcmp(t1->affiliation, t2->affiliation) == 0) &&
+         (strcmp(t1->degree, t2->degree) == 0) && (strcmp(t1->url, t2->url) == 0);
+}
+
+
+/* Function to fill field with pointers to the NFIELD fields of an
+ * entry, in the order they appear in the input text */
+void entry_fields(struct thesis *t, char **field) {
+
+  field[0] = t->author;
+  field[1] = t->year;
+  field[2] = t->title;
+  field[3] = t->advisor;
+  field[4] = t->affiliation;
+  field[5] = t->degree;
+  field[6] = t->url;
+}
+
+
+/* Function to write an entry back in the input text format, one field
+ * per line, leaving empty lines for missing fields */
+void write_text(FILE *fp, struct thesis *t) {
+
+  char *field[NFIELD];
+  int i;
+
+  entry_fields(t, field);
+
+  for (i=0; i<NFIELD; i++) {
+    fputs(field[i], fp);
+    fputc('\n', fp);
+  }
+}
+
+
+/* Function to fold the edit log into the input text file, writing the
+ * entries in sorted order to a new file that replaces the old one, and
+ * then removing the log */
+int compact_log(const char *fname, const char *logname, struct thesis *entry, int num) {
+
+  char tmpname[STRLEN+8];
+  FILE *fp;
+  int i;
+
+  snprintf(tmpname, sizeof(tmpname), "%s.tmp", fname);
+  fp = fopen(tmpname, "w");
+  if (fp == NULL) {
+    fprintf(stderr, "Failed to create file: %s\n", tmpname);
+    return -1;
+  }
+  for (i=0; i<num; i++) {
+    if (i > 0) fputc('\n', fp);
+    write_text(fp, &entry[i]);
+  }
+  if ((fflush(fp) != 0) || (fsync(fileno(fp)) != 0) || (fclose(fp) != 0) ||
+      (rename(tmpname, fname) != 0)) {
+    fprintf(stderr, "Failed to write file: %s\n", fname);
+    unlink(tmpname);
+    return -1;
+  }
+  if ((unlink(logname) != 0) && (access(logname, F_OK) == 0)) {
+    fprintf(stderr, "Failed to remove edit log: %s\n", logname);
+    return -1;
+  }
+
+  return 0;
+}
+
+
+/* Function to parse a text file and store information about each
+ * thesis/dissertation in the appropriate field of a structure and
+ * return the number of entries found. An author line followed by a
+ * year line starts a new entry, so a missing or extra line only
+ * affects the entry it occurs in rather than every later entry. Each
+ * entry is passed to keep, if given, which returns 0 to drop it */
+struct thesis *parse_text(FILE *fp, int *num, int (*keep)(struct thesis *, void *), void *arg) {
+
+  struct thesis *entry=NULL, *grow;
+  char buf[NSLOT][STRLEN];
+  char *line[NSLOT], *tmp;
+  int i, c, n=0, cnt=0, max=0;
+  size_t len;
+
+  for (i=0; i<NSLOT; i++) line[i] = buf[i];
+
+  /* Read in each line of text file */
+  while (fgets(line[n], STRLEN, fp) != NULL) {
+
+    /* Trim \n at end of each line returned by fgets, discarding the rest
+     * of any line too long for a field rather than reading it as the next */
+    len = strcspn(line[n], "\r\n");
+    if ((line[n][len] == '\0') && (len == STRLEN-1)) {
+      while (((c = fgetc(fp)) != EOF) && (c != '\n'));
+    }
+    line[n][len] = 0;
+
+    /* Skip blank lines before the first field of an entry */
+    if ((n == 0) && (len == 0)) continue;
+
+    /* Store the previous entry when the next author and year are found */
+    if ((n >= 3) && (line[n-1][0] != '\0') && is_year(line[n])) {
+      if (cnt == max) {
+        max = (max == 0) ? 256 : 2*max;
+        grow = realloc(entry, sizeof(struct thesis)*max);
+        if (grow == NULL) {
+          free(entry);
+          *num = -1;
+          return NULL;
+        }
+        entry = grow;
+      }
+      assign_fields(&entry[cnt], line, n-1);
+      if ((keep == NULL) || keep(&entry[cnt], arg)) cnt++;
+
+      tmp = line[0]; line[0] = line[n-1]; line[n-1] = tmp;
+      tmp = line[1]; line[1] = line[n]; line[n] = tmp;
+      n = 2;
+      continue;
+    }
+
+    /* Advance to next line of entry. If an entry has far more lines than
+     * fields the second line of its title is dropped, keeping the fields
+     * after the title and the last lines read, which find the next
+     * author and year */
+    if (n < NSLOT-1) n++;
+    else {
+      tmp = line[3];
+      for (i=3; i<n; i++) line[i] = line[i+1];
+      line[n] = tmp;
+    }
+  }
+
+  /* Store the final entry */
+  if (n > 0) {
+    if (cnt == max) {
+      grow = realloc(entry, sizeof(struct thesis)*(max+1));
+      if (grow == NULL) {
+        free(entry);
+        *num = -1;
+        return NULL;
+      }
+      entry = grow;
+    }
+    assign_fields(&entry[cnt], line, n);
+    if ((keep == NULL) || keep(&entry[cnt], arg)) cnt++;
+  }
+
+  /* Return the number of thesis/dissertation entries read from file */
+  *num = cnt;
+
+  return entry;
+}
+
+
+/* Function to give a parsed entry its sort key and id and keep it if it
+ * passes the filters in arg (if any), passing it to the stream renderer
+ * in arg as well if one is given */
+int keep_entry(struct thesis *t, void *arg) {
+
+  struct keep *kp = arg;
+
+  make_key(t);
+  make_id(t);
+  if (kp == NULL) return 1;
+  if (!match_filter(kp->fl, t)) return 0;
+  if (kp->st != NULL) stream_entry(kp->st, t);
+
+  return 1;
+}
+
+
+/* Function to compile a filter option and insert it into the chain
+ * ahead of any costlier filters: year ranges are integer comparisons,
+ * then whole-value matches, then substring searches, and filters on
+ * the short degree field before those on the affiliation */
+int add_filter(struct filter **chain, int field, const char *arg) {
+
+  struct filter *f, **p;
+  const char *dots;
+
+  f = malloc(sizeof(struct filter));
+  if (f == NULL) return -1;
+  memset(f, 0, sizeof(struct filter));
+  f->field = field;
+
+  if (field == YEAR_RANGE) {
+    dots = strstr(arg, "..");
+    f->lo = ((dots == arg) || (*arg == '\0')) ? 0 : atoi(arg);
+    f->hi = (dots == NULL) ? f->lo : ((dots[2] == '\0') ? 9999 : atoi(dots+2));
+    if ((!isdigit((unsigned char)arg[0]) && (dots != arg)) ||
+        ((dots != NULL) && (dots[2] != '\0') && !isdigit((unsigned char)dots[2]))) {
+      fprintf(stderr, "Invalid year range: %s\n", arg);
+      free(f);
+      return -1;
+    }
+  } else {
+    f->substr = (arg[0] == '~');
+    if (f->substr) arg++;
+    strncpy(f->value, arg, STRLEN-1);
+    f->cost = 1 + (field != DEGREE) + 2*f->substr;
+  }
+
+  for (p=chain; (*p != NULL) && ((*p)->cost <= f->cost); p=&(*p)->next);
+  f->next = *p;
+  *p = f;
+
+  return 0;
+}
+
+
+/* Function to check whether an entry passes every filter in the chain,
+ * stopping at the first that fails */
+int match_filter(struct filter *fl, struct thesis *t) {
+
+  int year;
+
+  for (; fl != NULL; fl=fl->next) {
+    switch (fl->field) {
+      case YEAR_RANGE:
+        year = atoi(t->year);
+        if ((year < fl->lo) || (year > fl->hi)) return 0;
+        break;
+      case DEGREE:
+        if (!match_text(fl, t->degree, strlen(t->degree))) return 0;
+        break;
+      default:
+        if (!match_affiliation(fl, t->affiliation)) return 0;
+    }
+  }
+
+  return 1;
+}
+
+
+/* Function to compare len characters of a string with a filter value,
+ * ignoring case */
+int match_text(struct filter *f, const char *str, int len) {
+
+  char buf[STRLEN];
+
+  if (!f->substr) return ((size_t)len == strlen(f->value)) && (strncasecmp(str, f->value, len) == 0);
+
+  memcpy(buf, str, len);
+  buf[len] = 0;
+
+  return strcasestr(buf, f->value) != NULL;
+}
+
+
+/* Function to match a filter against the institution or country of each
+ * affiliation separated by '&'. An institution without its own country
+ * shares the country of the next affiliation, as in "A & B, Canada" */
+int match_affiliation(struct filter *f, const char *affil) {
+
+  const char *part, *end, *comma, *next;
+  int len;
+
+  for (part=affil; *part != '\0'; part=next) {
+    end = strchr(part, '&');
+    next = (end == NULL) ? part+strlen(part) : end+1;
+    if (end == NULL) end = next;
+    while ((part < end) && isspace((unsigned char)*part)) part++;
+    while ((end > part) && isspace((unsigned char)end[-1])) end--;
+
+    /* Country after the last comma, institution before it */
+    for (comma=end; (comma > part) && (comma[-1] != ','); comma--);
+    if (f->field == COUNTRY) {
+      if (comma == part) continue;
+      while ((comma < end) && isspace((unsigned char)*comma)) comma++;
+      if (match_text(f, comma, end-comma)) return 1;
+    } else {
+      len = (comma == part) ? end-part : comma-1-part;
+      if (match_text(f, part, len)) return 1;
+    }
+  }
+
+  return 0;
+}
+
+
+/* Function to fold the character at *p to lowercase ASCII without
+ * diacritics, storing it in out and returning the number of bytes
+ * stored (0 for punctuation), and leaving *p at its last byte. Other
+ * UTF-8 characters are kept byte by byte, after all ASCII letters */
+int fold_char(const unsigned char **p, unsigned char *out) {
+
+  const char *latin1 = "aaaaaaaceeeeiiiidnooooo\0ouuuuyts"
+                       "aaaaaaaceeeeiiiidnooooo\0ouuuuyty";
+  const char *latinA = "aaaaaaccccccccddddeeeeeeeeeegggggggghhhhiiiiiiiiiiiijjkkk"
+                       "llllllllllnnnnnnnnnoooooooorrrrrrssssssssttttttuuuuuuuuuuuu"
+                       "wwyyyzzzzzzs";
+  const unsigned char *c = *p;
+
+  if (isalnum(c[0])) {
+    out[0] = tolower(c[0]);
+    return 1;
+  }
+
+  /* Two-byte sequences C3 80 to C3 BF cover À to ÿ, and C4 80 to C5 BF
+   * cover Ā to ſ */
+  if ((c[0] == 0xC3) && (c[1] >= 0x80) && (c[1] <= 0xBF)) {
+    (*p)++;
+    out[0] = latin1[c[1] - 0x80];
+    return (out[0] != 0);
+  }
+  if (((c[0] == 0xC4) || (c[0] == 0xC5)) && (c[1] >= 0x80) && (c[1] <= 0xBF)) {
+    (*p)++;
+    out[0] = latinA[((c[0] - 0xC4) << 6) | (c[1] - 0x80)];
+    return 1;
+  }
+
+  if (c[0] >= 0x80) {
+    out[0] = c[0];
+    return 1;
+  }
+
+  return 0;
+}
+
+
+/* Function to build the collation key of an entry once, so that sorting
+ * only needs memcmp(). The key holds the author's last name and then
+ * first names with case and diacritics folded, ignoring spaces and
+ * punctuation so that name particles sort the same however they are
+ * written (eg, "de Larquier" and "DeLarquier"), and with "St." and
+ * "Ste." spelled out. It is padded to NAMEKEY bytes and followed by
+ * the year and then the raw author, which only break ties */
+void make_key(struct thesis *t) {
+
+  unsigned char *key = t->key;
+  const unsigned char *p = (const unsigned char *)t->author;
+  int n=0, word=1, comma=0;
+
+  memset(key, 0, KEYLEN);
+  for (; (*p != '\0') && (n < NAMEKEY); p++) {
+
+    /* Separate the last name from the first names with a byte that
+     * sorts before any letter */
+    if ((*p == ',') && !comma) {
+      key[n++] = 1;
+      comma = word = 1;
+      continue;
+    }
+
+    if (word && (tolower(p[0]) == 's') && (p[1] == 't') &&
+        ((p[2] == '.') || (p[2] == ' ') || ((p[2] == 'e') && (p[3] == '.')))) {
+      strncpy((char *)key+n, (p[2] == 'e') ? "sainte" : "saint", NAMEKEY-n);
+      n += (p[2] == 'e') ? 6 : 5;
+      p += (p[2] == 'e') ? 2 : 1;
+      if (n > NAMEKEY) n = NAMEKEY;
+      continue;
+    }
+
+    word = (isspace(*p) || (*p == '.') || (*p == '-') || (*p == '\''));
+    n += fold_char(&p, key+n);
+  }
+
+  memcpy(key+NAMEKEY, t->year, strnlen(t->year, 4));
+  memcpy(key+NAMEKEY+4, t->author, strnlen(t->author, KEYLEN-NAMEKEY-4));
+}
+
+
+/* Function to compute the ID of an entry once, as a 64-bit FNV-1a hash
+ * of its author, year and title with case, diacritics, spaces and
+ * punctuation folded away, so that it is kept through small changes in
+ * how they are written. Characters fold_char() cannot fold to ASCII
+ * (eg, Greek, Cyrillic or CJK text, or signs such as ×) are hashed as
+ * their UTF-8 bytes, so that they still tell entries apart. It names
+ * the anchor of the entry in the html and identifies the entry across
+ * catalogues and edits */
+void make_id(struct thesis *t) {
+
+  const char *field[3];
+  const unsigned char *p, *q;
+  unsigned char c;
+  uint64_t h = 14695981039346656037ULL;
+  int i;
+
+  field[0] = t->author;
+  field[1] = t->year;
+  field[2] = t->title;
+  for (i=0; i<3; i++) {
+    for (p=(const unsigned char *)field[i]; *p != '\0'; p++) {
+      q = p;
+      if (fold_char(&p, &c) && (c < 0x80)) h = (h ^ c) * 1099511628211ULL;
+      else if (*q >= 0x80) {
+        h = (h ^ *q++) * 1099511628211ULL;
+        while ((*q & 0xC0) == 0x80) h = (h ^ *q++) * 1099511628211ULL;
+        p = q-1;
+      }
+    }
+    h = (h ^ '\n') * 1099511628211ULL;
+  }
+
+  t->id = h;
+}
+
+
+/* Function to check whether a line holds a four-digit year */
+int is_year(const char *line) {
+  return isdigit((unsigned char)line[0]) && isdigit((unsigned char)line[1]) &&
+         isdigit((unsigned char)line[2]) && isdigit((unsigned char)line[3]) &&
+         (line[4] == '\0');
+}
+
+
+/* Function to assign the n lines of an entry to the fields of a structure.
+ * Well-formed entries have seven lines (eight with the blank separator),
+ * while shorter or longer entries are assigned by rule: a trailing line
+ * starting with "http" is the URL, a known degree type is the degree,
+ * extra lines after the title are joined to it (eg, a wrapped title), and
+ * a lone line between the title and degree is taken to be the affiliation
+ * if it contains a comma but no "&" and the advisor otherwise */
+void assign_fields(struct thesis *t, char **line, int n) {
+
+  int i, m;
+  char **f;
+
+  /* Strip trailing blank lines, which are separators or empty fields */
+  while ((n > 2) && (line[n-1][0] == '\0')) n--;
+
+  strcpy(t->author, line[0]);
+  strcpy(t->year, (n > 1) ? line[1] : "");
+  t->title[0] = t->advisor[0] = t->affiliation[0] = t->degree[0] = t->url[0] = 0;
+
+  f = line+2;
+  m = n-2;
+  if (m <= 0) return;
+
+  if ((strncmp(f[m-1], "http", 4) == 0) || (m == 5)) strcpy(t->url, f[--m]);
+  if (m == 0) return;
+
+  for (i=0; i<(int)NDEGREE; i++) if (strcmp(f[m-1], degrees[i]) == 0) break;
+  if ((i < (int)NDEGREE) || (m == 4)) strcpy(t->degree, f[--m]);
+
+  strcpy(t->title, f[0]);
+  if (m > 3) {
+    for (i=1; i<m-2; i++) {
+      strncat(t->title, " ", STRLEN-strlen(t->title)-1);
+      strncat(t->title, f[i], STRLEN-strlen(t->title)-1);
+    }
+    strcpy(t->advisor, f[m-2]);
+    strcpy(t->affiliation, f[m-1]);
+  } else if (m == 3) {
+    strcpy(t->advisor, f[1]);
+    strcpy(t->affiliation, f[2]);
+  } else if (m == 2) {
+    if ((strchr(f[1], ',') != NULL) && (strchr(f[1], '&') == NULL)) strcpy(t->affiliation, f[1]);
+    else strcpy(t->advisor, f[1]);
+  }
+}
+
+
+/* Function to report a formatting error in an input text file */
+void diagnose(const char *fname, int lineno, const char *msg, const char *line) {
+  if (line == NULL) fprintf(stderr, "%s:%d: %s\n", fname, lineno, msg);
+  else fprintf(stderr, "%s:%d: %s: \"%.60s%s\"\n", fname, lineno, msg, line,
+               (strlen(line) > 60) ? "..." : "");
+}
+
+
+/* Function to sort the diagnostics of an entry by line (for use with
+ * qsort), keeping those on the same line in the order they were found */
+int compare_diag(const void *s1, const void *s2) {
+  const struct diag *d1 = (const struct diag *)s1;
+  const struct diag *d2 = (const struct diag *)s2;
+
+  if (d1->lineno != d2->lineno) return d1->lineno - d2->lineno;
+  return d1->order - d2->order;
+}
+
+
+/* Function to add a diagnostic to those of an entry */
+void add_diag(struct diag *dg, int *nd, int lineno, const char *msg, const char *line) {
+  dg[*nd].lineno = lineno;
+  dg[*nd].order = *nd;
+  dg[*nd].msg = msg;
+  dg[*nd].line = line;
+  (*nd)++;
+}
+
+
+/* Function to check the n lines of one entry for formatting errors,
+ * given which lines were too long and the first line of the entry after
+ * it (NULL at the end of the file), and report them in line order and
+ * return the number found. The lines are matched to fields as
+ * assign_fields does, so a missing field is reported by name rather
+ * than shifting the checks of the fields after it */
+int check_entry(const char *fname, char **line, int *lineno, char *toolong, int n,
+                const char *next, int nextno) {
+
+  const char *name[NFIELD] = {"missing author", "missing year", "missing title",
+                              "missing advisor", "missing affiliation", "missing degree", ""};
+  struct diag dg[4*NSLOT];
+  int field[NFIELD];
+  int i, m, c, b, u, at, incomplete, nd=0;
+  unsigned int d;
+  const char *p;
+
+  for (i=0; i<n; i++) if (toolong[i]) add_diag(dg, &nd, lineno[i], "line too long", line[i]);
+
+  /* Strip the trailing blank lines, which are the separator and an
+   * empty URL */
+  for (c=n; (c > 1) && (line[c-1][0] == '\0'); c--);
+  b = n-c;
+
+  /* Find the line holding each field, or -1 if it is missing */
+  for (i=0; i<NFIELD; i++) field[i] = (i < 2) && (i < c) ? i : -1;
+  m = c-2;
+  if ((m > 0) && ((strncmp(line[c-1], "http", 4) == 0) || (m == 5))) field[6] = 2 + --m;
+  if (m > 0) {
+    for (d=0; d<NDEGREE; d++) if (strcmp(line[1+m], degrees[d]) == 0) break;
+    if ((d < NDEGREE) || (m == 4)) field[5] = 2 + --m;
+  }
+  if (m > 0) field[2] = 2;
+  if (m >= 3) {
+    field[3] = m;
+    field[4] = m+1;
+  } else if (m == 2) {
+    if ((strchr(line[3], ',') != NULL) && (strchr(line[3], '&') == NULL)) field[4] = 3;
+    else field[3] = 3;
+  }
+
+  /* An entry without a URL keeps an empty line for it, and is followed
+   * by a blank line unless it ends the file */
+  u = (field[6] == -1);
+  incomplete = (next == NULL) && (b < u);
+  if (incomplete) add_diag(dg, &nd, lineno[n-1], "incomplete entry at end of file", NULL);
+  if ((next != NULL) && (b < u+1)) add_diag(dg, &nd, nextno, "missing blank line after entry", next);
+  for (i=c+u+1; i<n; i++) add_diag(dg, &nd, lineno[i], "extra blank line between entries", NULL);
+
+  /* Report each missing field at the line where the next field is,
+   * unless the entry was cut off by the end of the file */
+  for (i=0; (i<NFIELD-1) && !incomplete; i++) {
+    if (field[i] != -1) continue;
+    for (at=i+1; (at < NFIELD) && (field[at] == -1); at++);
+    add_diag(dg, &nd, (at < NFIELD) ? lineno[field[at]] : lineno[c-1]+1, name[i], NULL);
+  }
+
+  if ((field[0] != -1) && (strstr(line[field[0]], ", ") == NULL)) {
+    add_diag(dg, &nd, lineno[field[0]], "author should be \"Last Name, First Name\"", line[field[0]]);
+  }
+  if ((field[1] != -1) && !is_year(line[field[1]])) {
+    add_diag(dg, &nd, lineno[field[1]], "year should be YYYY", line[field[1]]);
+  }
+  if ((field[2] != -1) && (line[field[2]][0] == '\0')) add_diag(dg, &nd, lineno[field[2]], name[2], NULL);
+  for (i=3; i<m; i++) add_diag(dg, &nd, lineno[i], "extra line in entry", line[i]);
+  if ((field[3] != -1) && (strchr(line[field[3]], ',') != NULL) &&
+      (strchr(line[field[3]], '&') == NULL)) {
+    add_diag(dg, &nd, lineno[field[3]], "advisors should be \"First Last\" joined by \"&\"",
+             line[field[3]]);
+  }
+  if (field[5] != -1) {
+    for (d=0; d<NDEGREE; d++) if (strcmp(line[field[5]], degrees[d]) == 0) break;
+    if (d == NDEGREE) add_diag(dg, &nd, lineno[field[5]], "unknown degree", line[field[5]]);
+  }
+  if (field[6] != -1) {
+    p = line[field[6]];
+    if (strncmp(p, "http://", 7) == 0) p += 7;
+    else if (strncmp(p, "https://", 8) == 0) p += 8;
+    else p = NULL;
+    if ((p == NULL) || (strcspn(p, "/") == 0) || (memchr(p, '.', strcspn(p, "/")) == NULL) ||
+        (strpbrk(line[field[6]], " \t\"<>") != NULL)) {
+      add_diag(dg, &nd, lineno[field[6]], "malformed URL", line[field[6]]);
+    }
+  }
+
+  qsort(dg, nd, sizeof(struct diag), compare_diag);
+  for (i=0; i<nd; i++) diagnose(fname, dg[i].lineno, dg[i].msg, dg[i].line);
+
+  return nd;
+}
+
+
+/* Function to check a text file for formatting errors in a single pass,
+ * reporting each error with its line number, and return the number of
+ * errors found. Entries are split where parse_text splits them, at an
+ * author line followed by a year line, and also at the first line after
+ * the blank line that ends a complete entry, so that an error in one
+ * entry is not carried into the next */
+int validate_text(FILE *fp, const char *fname, int *num) {
+
+  char buf[NSLOT][STRLEN];
+  char *line[NSLOT], *tmp, toolong[NSLOT];
+  int lineno[NSLOT];
+  int i, c, k, n=0, ln=0, cnt=0, errors=0;
+  size_t len;
+
+  for (i=0; i<NSLOT; i++) line[i] = buf[i];
+
+  /* Read in each line of text file */
+  while (fgets(line[n], STRLEN, fp) != NULL) {
+    ln++;
+
+    /* Discard remainder of lines too long to fit in a field, which are
+     * those whose newline was not read with them */
+    toolong[n] = 0;
+    if (strchr(line[n], '\n') == NULL) {
+      c = fgetc(fp);
+      if (c == '\r') c = fgetc(fp);
+      if ((c != '\n') && (c != EOF)) {
+        toolong[n] = 1;
+        while (((c = fgetc(fp)) != EOF) && (c != '\n'));
+      }
+    }
+    len = strcspn(line[n], "\r\n");
+    line[n][len] = 0;
+    lineno[n] = ln;
+
+    if ((n == 0) && (len == 0)) {
+      if (toolong[n]) diagnose(fname, ln, "line too long", line[n]);
+      diagnose(fname, ln, "extra blank line between entries", NULL);
+      errors += 1 + toolong[n];
+      continue;
+    }
+
+    /* Check the previous entry when the next one starts */
+    k = -1;
+    if ((n >= 3) && (line[n-1][0] != '\0') && is_year(line[n])) k = n-1;
+    else if ((n >= NFIELD) && (len > 0) && (line[n-1][0] == '\0')) k = n;
+    if (k >= 0) {
+      errors += check_entry(fname, line, lineno, toolong, k, line[k], lineno[k]);
+      cnt++;
+      for (i=k; i<=n; i++) {
+        tmp = line[i-k]; line[i-k] = line[i]; line[i] = tmp;
+        lineno[i-k] = lineno[i];
+        toolong[i-k] = toolong[i];
+      }
+      n = n-k+1;
+      continue;
+    }
+
+    /* Advance to next line of entry, dropping the second line of the
+     * title if an entry has far more lines than fields as parse_text does */
+    if (n < NSLOT-1) n++;
+    else {
+      tmp = line[3];
+      for (i=3; i<n; i++) {
+        line[i] = line[i+1];
+        lineno[i] = lineno[i+1];
+        toolong[i] = toolong[i+1];
+      }
+      line[n] = tmp;
+    }
+  }
+
+  /* Check the final entry */
+  if (n > 0) {
+    errors += check_entry(fname, line, lineno, toolong, n, NULL, ln);
+    cnt++;
+  }
+
+  *num = cnt;
+
+  return errors;
+}
+
+
+/* Function to mix the bits of a 64-bit value (splitmix64 finalizer) */
+uint64_t mix64(uint64_t x) {
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  x ^= x >> 31;
+  return x;
+}
+
+
+/* Function to compute the MinHash signature of the character shingles
+ * in the folded author and title of a thesis/dissertation */
+void minhash(struct thesis *entry, uint64_t *sig) {
+
+  char text[2*STRLEN];
+  const char *p;
+  uint64_t h;
+  int i, j, n=0, space=1;
+
+  /* Fold to lowercase alphanumerics separated by single spaces */
+  for (j=0; j<2; j++) {
+    for (p=(j == 0) ? entry->author : entry->title; *p != 0; p++) {
+      if (isalnum((unsigned char)*p) || ((unsigned char)*p >= 0x80)) {
+        text[n++] = tolower((unsigned char)*p);
+        space = 0;
+      } else if (!space) {
+        text[n++] = ' ';
+        space = 1;
+      }
+    }
+    if (!space) {
+      text[n++] = ' ';
+      space = 1;
+    }
+  }
+
+  for (i=0; i<NHASH; i++) sig[i] = UINT64_MAX;
+
+  /* Hash each shingle once and derive the NHASH permutations from it */
+  for (j=0; j+SHINGLE<=n; j++) {
+    h = 0;
+    for (i=0; i<SHINGLE; i++) h = (h << 8) | (unsigned char)text[j+i];
+    h = mix64(h);
+    for (i=0; i<NHASH; i++) {
+      uint64_t v = mix64(h ^ (0x9e3779b97f4a7c15ULL * (i+1)));
+      if (v < sig[i]) sig[i] = v;
+    }
+  }
+}
+
+
+/* Function to sort LSH bucket keys (for use with qsort) */
+int compare_bucket(const void *s1, const void *s2) {
+  const uint64_t *b1 = (const uint64_t *)s1;
+  const uint64_t *b2 = (const uint64_t *)s2;
+
+  if (b1[0] != b2[0]) return (b1[0] < b2[0]) ? -1 : +1;
+  if (b1[1] != b2[1]) return (b1[1] < b2[1]) ? -1 : +1;
+  return 0;
+}
+
+
+/* Function to return the representative entry of a duplicate group */
+int find_group(int *group, int i) {
+  while (group[i] != i) i = group[i] = group[group[i]];
+  return i;
+}
+
+
+/* Function to find near-duplicate theses/dissertations, report them to
+ * stderr and merge each group into its first entry, filling any empty
+ * fields from the others, and return the number of remaining entries */
+int dedupe(struct thesis *entry, int num) {
+
+  uint64_t *sig, (*bucket)[2], h;
+  int *group;
+  int i, j, k, m, b, a, c, first, same, cnt=0;
+  char *dst[NFIELD], *src[NFIELD];
+
+  if (num < 2) return num;
+
+  sig = malloc(sizeof(uint64_t)*NHASH*num);
+  bucket = malloc(sizeof(uint64_t[2])*num);
+  group = malloc(sizeof(int)*num);
+  if ((sig == NULL) || (bucket == NULL) || (group == NULL)) {
+    fprintf(stderr, "Failed to allocate memory for duplicate search.\n");
+    free(sig);
+    free(bucket);
+    free(group);
+    return num;
+  }
+
+  for (i=0; i<num; i++) {
+    minhash(&entry[i], &sig[NHASH*i]);
+    group[i] = i;
+  }
+
+  /* Entries sharing all rows of any band become candidate pairs, found
+   * by sorting the band hashes rather than comparing every pair */
+  for (b=0; b<BANDS; b++) {
+    for (i=0; i<num; i++) {
+      h = b;
+      for (k=0; k<ROWS; k++) h = mix64(h ^ sig[NHASH*i+ROWS*b+k]);
+      bucket[i][0] = h;
+      bucket[i][1] = i;
+    }
+    qsort(bucket, num, sizeof(uint64_t[2]), compare_bucket);
+
+    /* Check every pair within each run of equal band hashes, as the
+     * first member of a run may differ (eg, in degree) from a duplicate
+     * pair later in it */
+    for (first=0; first<num; first=j) {
+      for (j=first+1; (j<num) && (bucket[j][0] == bucket[first][0]); j++);
+      for (i=first; i<j; i++) {
+        for (k=i+1; k<j; k++) {
+          a = bucket[i][1];
+          c = bucket[k][1];
+          if (find_group(group, a) == find_group(group, c)) continue;
+
+          /* Verify candidate using the estimated Jaccard similarity, and
+           * keep separate degrees by the same author (eg, MS and PhD) apart */
+          for (m=0, same=0; m<NHASH; m++) same += (sig[NHASH*a+m] == sig[NHASH*c+m]);
+          if (same < DEDUPE_THRESHOLD*NHASH) continue;
+          if (strcmp(entry[a].degree, entry[c].degree) != 0) continue;
+
+          fprintf(stderr, "Duplicate (%.2f): %s (%s) ~ %s (%s)\n",
+                  (double)same/NHASH, entry[a].author, entry[a].year,
+                  entry[c].author, entry[c].year);
+          if (a < c) group[find_group(group, c)] = find_group(group, a);
+          else       group[find_group(group, a)] = find_group(group, c);
+        }
+      }
+    }
+  }
+
+  /* Merge each duplicate into the first entry of its group */
+  for (i=0; i<num; i++) {
+    a = find_group(group, i);
+    if (a == i) continue;
+    entry_fields(&entry[a], dst);
+    entry_fields(&entry[i], src);
+    for (k=0; k<NFIELD; k++) if (dst[k][0] == '\0') strcpy(dst[k], src[k]);
+    make_key(&entry[a]);
+    make_id(&entry[a]);
+  }
+
+  /* Compact the remaining entries */
+  for (i=0; i<num; i++) {
+    if (find_group(group, i) != i) continue;
+    if (cnt != i) entry[cnt] = entry[i];
+    cnt++;
+  }
+
+  if (cnt < num) fprintf(stderr, "Merged %d duplicate entries.\n", num-cnt);
+
+  free(sig);
+  free(bucket);
+  free(group);
+
+  return cnt;
+}
+
+
+/* Function to sort theses/dissertations first by author last name
+ * and then by year (for use with qsort) */
+int compare(const void *s1, const void *s2) {
+  struct thesis *t1 = (struct thesis *)s1;
+  struct thesis *t2 = (struct thesis *)s2;
+
+  return memcmp(t1->key, t2->key, KEYLEN);
+}
+
+
+/* Function to write a string with the html special characters & < > " '
+ * replaced by entities. Runs of ordinary characters are found with
+ * strcspn, which the C library vectorizes, and written in one call */
+void write_escaped(FILE *fp, const char *str) {
+
+  size_t n;
+
+  while (*str != '\0') {
+    n = strcspn(str, "&<>\"'");
+    if (n > 0) fwrite_unlocked(str, 1, n, fp);
+    str += n;
+
+    switch (*str) {
+      case '&':  PUT_LIT(fp, "&amp;"); break;
+      case '<':  PUT_LIT(fp, "&lt;"); break;
+      case '>':  PUT_LIT(fp, "&gt;"); break;
+      case '"':  PUT_LIT(fp, "&quot;"); break;
+      case '\'': PUT_LIT(fp, "&#39;"); break;
+      default:   return;
+    }
+    str++;
+  }
+}
+
+
+/* Function to copy a string into dst with the html special characters
+ * replaced by entities, returning the end of the copy */
+char *copy_escaped(char *dst, const char *str) {
+
+  size_t n;
+
+  while (*str != '\0') {
+    n = strcspn(str, "&<>\"'");
+    memcpy(dst, str, n);
+    dst += n;
+    str += n;
+
+    switch (*str) {
+      case '&':  CPY_LIT(dst, "&amp;"); break;
+      case '<':  CPY_LIT(dst, "&lt;"); break;
+      case '>':  CPY_LIT(dst, "&gt;"); break;
+      case '"':  CPY_LIT(dst, "&quot;"); break;
+      case '\'': CPY_LIT(dst, "&#39;"); break;
+      default:   return dst;
+    }
+    str++;
+  }
+  return dst;
+}
+
+
+/* Function to copy a 64-bit ID into dst as 16 hex digits, returning
+ * the end of the copy */
+char *copy_hex(char *dst, uint64_t v) {
+
+  int i;
+
+  for (i=15; i>=0; i--) {
+    dst[i] = "0123456789abcdef"[v & 15];
+    v >>= 4;
+  }
+  return dst+16;
+}
+
+/* Function to write a 64-bit ID as 16 hex digits */
+void write_hex(FILE *fp, uint64_t v) {
+
+  char buf[16];
+
+  copy_hex(buf, v);
+  fwrite_unlocked(buf, 1, 16, fp);
+}
+
+
+/* Function to write the html table for one thesis/dissertation. The
+ * table is built in a local buffer from literals of known length and
+ * the escaped fields, then written with a single call */
+void write_entry(FILE *fp, struct thesis *entry) {
+
+  char buf[ENTRYLEN], *p = buf;
+
+  CPY_LIT(p, "  <a name=r");
+  p = copy_hex(p, entry->id);
+  CPY_LIT(p, "></a>\n  <table style=\"border:1px solid black; width:600px;\">\n"
+             "    <tr><td><b>Author:</b> ");
+  p = copy_escaped(p, entry->author);
+  CPY_LIT(p, "</td></tr>\n    <tr><td><b>Year:</b> ");
+  p = copy_escaped(p, entry->year);
+  CPY_LIT(p, "</td></tr>\n    <tr><td><b>Title:</b> ");
+  p = copy_escaped(p, entry->title);
+  CPY_LIT(p, "</td></tr>\n    <tr><td><b>Advisor:</b> ");
+  p = copy_escaped(p, entry->advisor);
+  CPY_LIT(p, "</td></tr>\n    <tr><td><b>Affiliation:</b> ");
+  p = copy_escaped(p, entry->affiliation);
+  CPY_LIT(p, "</td></tr>\n    <tr><td><b>Degree:</b> ");
+  p = copy_escaped(p, entry->degree);
+  if (entry->url[0] == '\0') {
+    CPY_LIT(p, "</td></tr>\n  </table><br>\n\n");
+  } else {
+    CPY_LIT(p, "</td><td align=\"right\"><a href=\"");
+    p = copy_escaped(p, entry->url);
+    CPY_LIT(p, "\" target=\"_blank\">URL</a></td></tr>\n  </table><br>\n\n");
+  }
+  fwrite_unlocked(buf, 1, p-buf, fp);
+}
+
+
+/* Function to return the uppercase ASCII letter an author name starts
+ * with, folding lowercase and accented (UTF-8 Latin-1) letters such as
+ * "André" or "Øieroset", or 0 if it does not start with a letter */
+int fold_letter(const char *str) {
+
+  const unsigned char *p = (const unsigned char *)str;
+  unsigned char c;
+
+  if (fold_char(&p, &c) && isalpha(c)) return toupper(c);
+
+  return 0;
+}
+
+
+/* Function to return the jump link section an entry falls in from the
+ * first byte of its collation key, so that the sections follow the sort
+ * order: 0 to 25 for A to Z, NLETTER-1 for initials that sort after Z
+ * (eg, Greek, Cyrillic or CJK names), or -1 for names that sort before
+ * A, which are written ahead of the first section */
+int initial_slot(struct thesis *t) {
+
+  if (t->key[0] < 'a') return -1;
+  if (t->key[0] <= 'z') return t->key[0]-'a';
+
+  return NLETTER-1;
+}
+
+
+/* Function to choose nbucket jump links from a histogram of author
+ * initials, starting a new section at the first initial where the
+ * running count reaches the next multiple of num/nbucket, and return
+ * the number of sections. Initials after Z get an "Other" section of
+ * their own after these */
+int make_buckets(int *hist, int num, int nbucket, int *start, char (*alph)[8]) {
+
+  int i, k=0, cum, other=hist[NLETTER-1];
+
+  if (nbucket < 1) nbucket = 1;
+  if (nbucket > 26) nbucket = 26;
+  num -= other;
+  if ((num > 0) || (other == 0)) {
+    start[0] = 0;
+    for (i=0, k=1, cum=0; (i < 26) && (k < nbucket); i++) {
+      if ((cum >= (double)k*num/nbucket) && (i > start[k-1])) start[k++] = i;
+      cum += hist[i];
+    }
+    nbucket = k;
+    for (k=0; k<nbucket; k++) {
+      i = (k < nbucket-1) ? start[k+1]-1 : 25;
+      if (i == start[k]) sprintf(alph[k], "%c", 'A'+start[k]);
+      else sprintf(alph[k], "%c-%c", 'A'+start[k], 'A'+i);
+    }
+  }
+  if (other > 0) {
+    start[k] = NLETTER-1;
+    strcpy(alph[k++], "Other");
+  }
+
+  return k;
+}
+
+
+/* Function to write the start of the html, with the jump links */
+void write_header(FILE *fp, int nbucket, char (*alph)[8]) {
+
+  int i;
+
+  /* Start writing html output */
+  fprintf(fp, "<!-- *** BEGIN THESIS/DISSERTATION CONTENT HERE *** --!>\n");
+  fprintf(fp, "<div align=\"center\">\n\n");
+
+  /* Build alphabetical links */
+  fprintf(fp, "  <b>Jump to:</b>&nbsp;\n");
+  for (i=0; i<nbucket-1; i++) {
+    fprintf(fp, "  <a href=\"#%s\">%s</a>&nbsp;|\n",alph[i],alph[i]);
+  }
+  fprintf(fp, "  <a href=\"#%s\">%s</a>\n\n",alph[i],alph[i]);
+  fprintf(fp, "  <br><br>\n\n");
+}
+
+
+/* Function to write the end of the html, with the number of items */
+void write_footer(FILE *fp, int num, int ms_cnt, int phd_cnt) {
+
+  /* Print total number of items at bottom of page */
+  fprintf(fp, "  <center>Number of items: <b>%d</b></center>\n", num);
+  fprintf(fp, "  <center>(%d MS | %d PhD)</center>\n\n",ms_cnt,phd_cnt);
+
+  /* Finish writing html output */
+  fprintf(fp, "</div>\n");
+  fprintf(fp, "<!-- *** END THESIS/DISSERTATION CONTENT HERE *** --!>\n");
+}
+
+
+/* Function to build the thesis/dissertation html and
+ * write it to stdout */
+int write_html(struct thesis *entry, int num, int nbucket) {
+
+  int i, j=0;
+  int ms_cnt=0, phd_cnt=0;
+  int hist[NLETTER], start[NLETTER], slot;
+  char alph[NLETTER][8];
+
+  /* Count entries by folded author initial, counting any that sort
+   * before A under A */
+  memset(hist, 0, sizeof(hist));
+  for (i=0; i<num; i++) {
+    slot = initial_slot(&entry[i]);
+    hist[(slot < 0) ? 0 : slot]++;
+  }
+  nbucket = make_buckets(hist, num, nbucket, start, alph);
+
+  write_header(stdout, nbucket, alph);
+
+  /* Step through each thesis/dissertation */
+  for (i=0; i<num; i++) {
+
+    /* Count number of theses/dissertations by degree type */
+    if (strcmp(entry[i].degree, "MS") == 0) ms_cnt++;
+    else if (strcmp(entry[i].degree, "PhD") == 0) phd_cnt++;
+
+    /* Insert alphabetical links where necessary */
+    slot = initial_slot(&entry[i]);
+    while ( (j < nbucket) && (slot >= start[j]) ) {
+      fprintf(stdout, "  <a name=%s></a>\n\n",alph[j]);
+      j++;
+    }
+  
+    /* Build html table for each thesis/dissertation */
+    write_entry(stdout, &entry[i]);
+  }
+
+  write_footer(stdout, num, ms_cnt, phd_cnt);
+
+  return(0);
+}
+
+
+/* Function to render one entry of presorted input as soon as it is
+ * parsed, recording where each author initial starts so that the jump
+ * link anchors can be inserted once the section sizes are known. The
+ * stream is abandoned if an entry is found out of order */
+void stream_entry(struct stream *st, struct thesis *entry) {
+
+  int slot;
+
+  if (!st->sorted) return;
+  if ((st->cnt > 0) && (compare(&st->prev, entry) > 0)) {
+    st->sorted = 0;
+    return;
+  }
+  memcpy(st->prev.key, entry->key, KEYLEN);
+  st->cnt++;
+
+  /* Count number of theses/dissertations by initial and degree type */
+  slot = initial_slot(entry);
+  st->hist[(slot < 0) ? 0 : slot]++;
+  while (st->maxletter < slot) st->off[++st->maxletter] = ftell(st->body);
+  if (strcmp(entry->degree, "MS") == 0) st->ms_cnt++;
+  else if (strcmp(entry->degree, "PhD") == 0) st->phd_cnt++;
+
+  /* Build html table for each thesis/dissertation */
+  write_entry(st->body, entry);
+}
+
+
+/* Function to start rendering presorted input, straight to stdout if it
+ * is a regular file not opened for appending that can be reopened for
+ * reading (so that the jump links can be inserted afterwards), or to a
+ * memory buffer otherwise */
+int open_stream(struct stream *st) {
+
+  struct stat sb;
+  char path[64];
+  int fd = fileno(stdout);
+
+  memset(st, 0, sizeof(struct stream));
+  st->sorted = 1;
+  st->maxletter = -1;
+  st->fd = -1;
+
+  fflush(stdout);
+  st->base = ftell(stdout);
+  if ((st->base >= 0) && (fstat(fd, &sb) == 0) && S_ISREG(sb.st_mode) &&
+      ((fcntl(fd, F_GETFL) & O_APPEND) == 0)) {
+    sprintf(path, "/proc/self/fd/%d", fd);
+    st->fd = open(path, O_RDWR);
+  }
+  if (st->fd >= 0) {
+    st->body = stdout;
+    return 0;
+  }
+
+  st->body = open_memstream(&st->buf, &st->size);
+  return (st->body == NULL) ? -1 : 0;
+}
+
+
+/* Function to write the html rendered from presorted input to stdout,
+ * inserting the jump link anchors. Returns 1 if the input was not in
+ * sorted order, or -1 if the output could not be written. Entries already written to a file are moved down in
+ * place to make room for the header and anchors, and are discarded if
+ * the input was not sorted */
+int write_stream(struct stream *st, int nbucket) {
+
+  int j, k, start[NLETTER];
+  char alph[NLETTER][8], anchor[NLETTER][32], *head=NULL;
+  off_t point[NLETTER+1], shift[NLETTER+1], end;
+  size_t hsize=0;
+  long pos=0;
+  FILE *fp;
+
+  if (st->fd < 0) fclose(st->body);
+  if (!st->sorted) {
+    if (st->fd >= 0) {
+      fflush(stdout);
+      k = ftruncate(st->fd, st->base);
+      close(st->fd);
+      if (k != 0) return -1;
+      fseek(stdout, st->base, SEEK_SET);
+    }
+    free(st->buf);
+    return 1;
+  }
+
+  nbucket = make_buckets(st->hist, st->cnt, nbucket, start, alph);
+
+  if (st->fd < 0) {
+    write_header(stdout, nbucket, alph);
+
+    /* Insert alphabetical links before the first entry of each section */
+    for (j=0; (j < nbucket) && (start[j] <= st->maxletter); j++) {
+      fwrite(st->buf+pos, 1, st->off[start[j]]-pos, stdout);
+      fprintf(stdout, "  <a name=%s></a>\n\n",alph[j]);
+      pos = st->off[start[j]];
+    }
+    fwrite(st->buf+pos, 1, st->size-pos, stdout);
+
+    write_footer(stdout, st->cnt, st->ms_cnt, st->phd_cnt);
+    free(st->buf);
+    return(0);
+  }
+
+  /* Split the entries written so far at the start of each section, and
+   * move each part down by the size of the header and the anchors
+   * before it, starting with the last */
+  fflush(stdout);
+  fp = open_memstream(&head, &hsize);
+  if (fp == NULL) {
+    close(st->fd);
+    return -1;
+  }
+  write_header(fp, nbucket, alph);
+  fclose(fp);
+
+  end = ftell(stdout);
+  point[0] = st->base;
+  shift[0] = hsize;
+  for (j=0; (j < nbucket) && (start[j] <= st->maxletter); j++) {
+    sprintf(anchor[j], "  <a name=%s></a>\n\n", alph[j]);
+    point[j+1] = st->off[start[j]];
+    shift[j+1] = shift[j] + strlen(anchor[j]);
+  }
+  for (k=j; k>=0; k--) {
+    if (move_back(st->fd, point[k], point[k]+shift[k], ((k < j) ? point[k+1] : end) - point[k]) != 0) break;
+    if ((k > 0) && (pwrite(st->fd, anchor[k-1], strlen(anchor[k-1]), point[k]+shift[k-1]) < 0)) break;
+  }
+  if ((k < 0) && (pwrite(st->fd, head, hsize, st->base) == (ssize_t)hsize)) k = 0;
+  else k = -1;
+  free(head);
+  close(st->fd);
+  if (k != 0) return -1;
+
+  fseek(stdout, end+shift[j], SEEK_SET);
+  write_footer(stdout, st->cnt, st->ms_cnt, st->phd_cnt);
+
+  return(0);
+}
+
+
+/* Function to move len bytes of a file from offset from to a later
+ * offset to, copying the last block first so nothing is overwritten
+ * before it has been read */
+int move_back(int fd, off_t from, off_t to, off_t len) {
+
+  char *buf;
+  off_t n;
+
+  if ((len == 0) || (from == to)) return 0;
+  buf = malloc(BLOCKSIZE);
+  if (buf == NULL) return -1;
+
+  while (len > 0) {
+    n = (len < BLOCKSIZE) ? len : BLOCKSIZE;
+    len -= n;
+    if ((pread(fd, buf, n, from+len) != n) || (pwrite(fd, buf, n, to+len) != n)) {
+      free(buf);
+      return -1;
+    }
+  }
+  free(buf);
+
+  return 0;
+}
+
+
+/* Function to copy the first n (UTF-8) characters of an author name
+ * into dst, which holds size bytes, capitalizing the first letter. At
+ * most 3 continuation bytes are kept after each lead byte, so malformed
+ * names cannot run past dst */
+void copy_chars(char *dst, int size, const char *src, int n) {
+
+  int i=0, k;
+
+  while ((*src != '\0') && (*src != ',') && (n > 0) && (i < size-4)) {
+    dst[i++] = *src++;
+    for (k=0; (k < 3) && (((unsigned char)*src & 0xC0) == 0x80); k++) dst[i++] = *src++;
+    while (((unsigned char)*src & 0xC0) == 0x80) src++;
+    n--;
+  }
+  dst[i] = 0;
+  dst[0] = toupper((unsigned char)dst[0]);
+}
+
+
+/* Function to write links to every page, labelled by the range of
+ * author names they hold, followed by prev/next links */
+void write_pager(FILE *fp, struct pages *p, int page) {
+
+  int i;
+
+  fprintf(fp, "  <b>Jump to:</b>&nbsp;\n");
+  for (i=1; i<=p->npage; i++) {
+    if (i == page) fprintf(fp, "  <b>");
+    else fprintf(fp, "  <a href=\"page-%d.html\">", i);
+    write_escaped(fp, p->label[i-1]);
+    fprintf(fp, (i == page) ? "</b>" : "</a>");
+    fprintf(fp, (i < p->npage) ? "&nbsp;|\n" : "\n");
+  }
+  fprintf(fp, "  <br>\n");
+  if (page > 1) fprintf(fp, "  <a href=\"page-%d.html\">&laquo; Prev</a>\n", page-1);
+  if ((page > 1) && (page < p->npage)) fprintf(fp, "  &nbsp;|&nbsp;\n");
+  if (page < p->npage) fprintf(fp, "  <a href=\"page-%d.html\">Next &raquo;</a>\n", page+1);
+  fprintf(fp, "  <br><br>\n\n");
+}
+
+
+/* Function to build the html for one page of theses/dissertations
+ * in memory and write it to its own file */
+int write_page(struct pages *p, int page) {
+
+  char path[2*STRLEN];
+  char *buf=NULL;
+  size_t size=0;
+  FILE *fp, *out;
+  int i, first, n, status=0;
+  int ms_cnt=0, phd_cnt=0;
+
+  first = (page-1)*p->pagesize;
+  n = p->num - first;
+  if (n > p->pagesize) n = p->pagesize;
+
+  fp = open_memstream(&buf, &size);
+  if (fp == NULL) return -1;
+
+  /* Start writing html output to page */
+  fprintf(fp, "<!-- *** BEGIN THESIS/DISSERTATION CONTENT HERE *** --!>\n");
+  fprintf(fp, "<div align=\"center\">\n\n");
+  write_pager(fp, p, page);
+
+  /* Step through each thesis/dissertation on this page */
+  for (i=first; i<first+n; i++) {
+
+    /* Count number of theses/dissertations by degree type */
+    if (strcmp(p->entry[i].degree, "MS") == 0) ms_cnt++;
+    else if (strcmp(p->entry[i].degree, "PhD") == 0) phd_cnt++;
+
+    /* Build html table for each thesis/dissertation */
+    write_entry(fp, &p->entry[i]);
+  }
+
+  /* Print number of items on this page and in total at bottom of page */
+  write_pager(fp, p, page);
+  fprintf(fp, "  <center>Number of items: <b>%d</b> of %d</center>\n", n, p->num);
+  fprintf(fp, "  <center>(%d MS | %d PhD)</center>\n\n",ms_cnt,phd_cnt);
+
+  /* Finish writing html output to page */
+  fprintf(fp, "</div>\n");
+  fprintf(fp, "<!-- *** END THESIS/DISSERTATION CONTENT HERE *** --!>\n");
+
+  if (fclose(fp) != 0) {
+    free(buf);
+    return -1;
+  }
+
+  /* Write page to its file with a single call */
+  sprintf(path, "%s/page-%d.html", p->outdir, page);
+  out = fopen(path, "w");
+  if ((out == NULL) || (fwrite(buf, 1, size, out) != size)) status = -1;
+  if ((out != NULL) && (fclose(out) != 0)) status = -1;
+
+  /* Hand the page to the compression thread, which frees it */
+  if ((status == 0) && (p->gz != NULL)) gz_push(p->gz, path, buf, size);
+  else free(buf);
+
+  return(status);
+}
+
+
+/* Function to take pages from the shared counter and write them until
+ * none are left (run by each thread) */
+void *write_page_thread(void *arg) {
+
+  struct pages *p = (struct pages *)arg;
+  int page;
+
+  for (;;) {
+    pthread_mutex_lock(&p->lock);
+    page = ++p->next;
+    pthread_mutex_unlock(&p->lock);
+    if (page > p->npage) break;
+
+    if (write_page(p, page) != 0) {
+      pthread_mutex_lock(&p->lock);
+      p->errors++;
+      pthread_mutex_unlock(&p->lock);
+    }
+  }
+
+  return NULL;
+}
+
+
+/* Function to split the sorted theses/dissertations into pages of
+ * pagesize entries and write the pages concurrently. The thread pool
+ * follows render_pages in parse_theses_site.c, but is kept here because
+ * each example program builds on its own from a single file, and these
+ * pages carry author-range jump links rather than the site's pager */
+int write_pages(struct thesis *entry, int num, int pagesize, char *outdir, int nthread,
+                int gzip) {
+
+  struct pages p;
+  struct gzqueue gz;
+  pthread_t *thread;
+  char first[16], last[16];
+  int i, n;
+
+  p.entry = entry;
+  p.num = num;
+  p.pagesize = pagesize;
+  p.npage = (num + pagesize - 1) / pagesize;
+  if (p.npage == 0) p.npage = 1;
+  p.outdir = outdir;
+  p.gz = (gzip) ? &gz : NULL;
+  p.next = 0;
+  p.errors = 0;
+
+  /* Label each page by the first two letters of its first and last authors */
+  p.label = malloc(sizeof(p.label[0])*p.npage);
+  if (p.label == NULL) return -1;
+  for (i=0; i<p.npage; i++) {
+    n = ((i+1)*pagesize < num) ? (i+1)*pagesize : num;
+    if (n == 0) {
+      strcpy(p.label[i], "1");
+      continue;
+    }
+    copy_chars(first, sizeof(first), entry[i*pagesize].author, 2);
+    copy_chars(last, sizeof(last), entry[n-1].author, 2);
+    if (strcmp(first, last) == 0) sprintf(p.label[i], "%s", first);
+    else sprintf(p.label[i], "%s-%s", first, last);
+  }
+
+  /* Start compressing pages as soon as they are written */
+  if ((p.gz != NULL) && (gz_start(p.gz) == -1)) {
+    fprintf(stderr, "Failed to start compression thread.\n");
+    free(p.label);
+    return -1;
+  }
+
+  /* Write pages on a pool of threads */
+  if (nthread > p.npage) nthread = p.npage;
+  if (nthread < 1) nthread = 1;
+  thread = malloc(sizeof(pthread_t)*nthread);
+  if (thread == NULL) {
+    if (p.gz != NULL) gz_finish(p.gz);
+    free(p.label);
+    return -1;
+  }
+  pthread_mutex_init(&p.lock, NULL);
+  for (i=0; i<nthread; i++) {
+    if (pthread_create(&thread[i], NULL, write_page_thread, &p) != 0) break;
+  }
+  if (i == 0) write_page_thread(&p);
+  nthread = i;
+  for (i=0; i<nthread; i++) pthread_join(thread[i], NULL);
+  pthread_mutex_destroy(&p.lock);
+  free(thread);
+  free(p.label);
+
+  /* Wait for the last pages to be compressed */
+  if (p.gz != NULL) p.errors += gz_finish(p.gz);
+
+  if (p.errors > 0) {
+    fprintf(stderr, "Failed to write %d pages.\n", p.errors);
+    return -1;
+  }
+
+  return(0);
+}
+
+
+/* Function to load the entries and answer HTTP/1.1 requests until the
+ * program is killed. The accepting thread hands each connection to a
+ * pool of nthread threads and reloads the input files when they change,
+ * swapping in the new entries once they are indexed so that requests
+ * already being answered finish with the old ones. Records added to the
+ * edit log are instead applied to the index in place (unless --dedupe
+ * is given, as merging duplicates needs every entry). The queries are:
+ *
+ *   GET /?q=..           entries whose author, title, advisor or
+ *                        affiliation contain q (ignoring case), also
+ *                        filtered by year=, degree=, advisor= and
+ *                        affiliation=, ordered by sort=author (default)
+ *                        or sort=year, from offset= with at most limit=
+ *                        entries
+ *   GET /facets?field=.. number of matching entries with each year,
+ *                        degree, advisor or affiliation
+ *
+ * Both answer with html unless format=json is given. Responses are
+ * written as they are built through the buffer owned by each thread */
+int serve_dataset(const char *addr, char **fname, int nfile, const char *logname,
+                  int dedup, struct filter *fl, int nthread) {
+
+  struct server sv;
+  struct sockaddr_in sa;
+  struct pollfd pfd;
+  struct dataset *d, *old;
+  char host[STRLEN];
+  const char *port;
+  pthread_t *thread;
+  struct stat st;
+  long long mtime;
+  int i, fd, on=1;
+
+  memset(&sv, 0, sizeof(sv));
+  sv.fname = fname;
+  sv.nfile = nfile;
+  sv.logname = logname;
+  sv.dedup = dedup;
+  sv.filter = fl;
+  pthread_mutex_init(&sv.lock, NULL);
+  pthread_cond_init(&sv.ready, NULL);
+  pthread_cond_init(&sv.space, NULL);
+
+  /* Listen on the loopback interface unless a host is given */
+  port = strrchr(addr, ':');
+  memset(&sa, 0, sizeof(sa));
+  sa.sin_family = AF_INET;
+  sa.sin_port = htons(atoi((port != NULL) ? port+1 : addr));
+  sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if ((port != NULL) && (port > addr) && (port-addr < STRLEN)) {
+    memcpy(host, addr, port-addr);
+    host[port-addr] = 0;
+    if (inet_pton(AF_INET, host, &sa.sin_addr) != 1) {
+      fprintf(stderr, "Invalid address: %s\n", addr);
+      return (-1);
+    }
+  }
+
+  /* Load entries before accepting connections */
+  sv.mtime = input_mtime(&sv);
+  sv.data = load_dataset(&sv);
+  if (sv.data == NULL) return (-1);
+
+  fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) {
+    fprintf(stderr, "Failed to create socket.\n");
+    return (-1);
+  }
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  if ((bind(fd, (struct sockaddr *)&sa, sizeof(sa)) != 0) || (listen(fd, CONNQUEUE) != 0)) {
+    fprintf(stderr, "Failed to listen on %s\n", addr);
+    close(fd);
+    return (-1);
+  }
+
+  /* Writes to connections closed early should fail rather than exit */
+  signal(SIGPIPE, SIG_IGN);
+
+  thread = malloc(sizeof(pthread_t)*nthread);
+  if (thread == NULL) {
+    fprintf(stderr, "Failed to allocate memory for threads.\n");
+    return (-1);
+  }
+  for (i=0; i<nthread; i++) {
+    if (pthread_create(&thread[i], NULL, serve_thread, &sv) != 0) break;
+  }
+  if (i == 0) {
+    fprintf(stderr, "Failed to start server threads.\n");
+    return (-1);
+  }
+
+  fprintf(stderr, "Serving %d items on %s:%d\n", sv.data->ix->num,
+          inet_ntoa(sa.sin_addr), ntohs(sa.sin_port));
+
+  pfd.fd = fd;
+  pfd.events = POLLIN;
+  for (;;) {
+
+    /* Queue each new connection, waiting while the queue is full */
+    if ((poll(&pfd, 1, 1000) == 1) && ((i = accept(fd, NULL, NULL)) >= 0)) {
+      pthread_mutex_lock(&sv.lock);
+      while (sv.count == CONNQUEUE) pthread_cond_wait(&sv.space, &sv.lock);
+      sv.conn[(sv.head + sv.count) % CONNQUEUE] = i;
+      sv.count++;
+      pthread_cond_signal(&sv.ready);
+      pthread_mutex_unlock(&sv.lock);
+    }
+
+    /* Apply the records added to the edit log since it was last read,
+     * or reload the entries if an input file has changed or the log
+     * was replaced */
+    mtime = input_mtime(&sv);
+    if (stat(sv.logname, &st) != 0) st.st_size = 0;
+    if ((mtime == sv.mtime) && (st.st_size == sv.logoff)) continue;
+    if ((mtime == sv.mtime) && (st.st_size > sv.logoff) && !sv.dedup) {
+      i = update_dataset(&sv, sv.data);
+      if (i > 0) fprintf(stderr, "Applied %d edit log records, %d items\n", i, sv.data->ix->num);
+      if (i >= 0) continue;
+    }
+    sv.mtime = mtime;
+    d = load_dataset(&sv);
+    if (d == NULL) {
+      fprintf(stderr, "Keeping previous entries.\n");
+      continue;
+    }
+    pthread_mutex_lock(&sv.lock);
+    old = sv.data;
+    sv.data = d;
+    pthread_mutex_unlock(&sv.lock);
+    release_dataset(&sv, old);
+    fprintf(stderr, "Reloaded %d items\n", d->ix->num);
+  }
+
+  return (0);
+}
+
+
+/* Function to parse the input files and insert their entries into the
+ * index of a new dataset held by the server. The size of the edit log is
+ * taken first, so records appended while it is read are applied again
+ * by update_dataset, which leaves the entries unchanged */
+struct dataset *load_dataset(struct server *sv) {
+
+  struct dataset *d;
+  struct thesis *entry;
+  struct stat st;
+  pthread_rwlockattr_t attr;
+  int i, num;
+
+  sv->logoff = (stat(sv->logname, &st) == 0) ? st.st_size : 0;
+  entry = read_files(sv->fname, sv->nfile, sv->logname, &num, sv->filter, NULL);
+  if (num == -1) return NULL;
+  if (sv->dedup) num = dedupe(entry, num);
+
+  d = malloc(sizeof(struct dataset));
+  if (d != NULL) d->ix = index_create();
+  if ((d == NULL) || (d->ix == NULL)) {
+    free(d);
+    free(entry);
+    return NULL;
+  }
+  d->refs = 1;
+
+  /* Prefer the writer, so that a steady stream of requests cannot hold
+   * off edits to the index */
+  pthread_rwlockattr_init(&attr);
+  pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+  pthread_rwlock_init(&d->rw, &attr);
+  pthread_rwlockattr_destroy(&attr);
+
+  for (i=0; i<num; i++) {
+    if (index_insert(d->ix, &entry[i]) == NULL) break;
+  }
+  free(entry);
+  if (i < num) {
+    pthread_rwlock_destroy(&d->rw);
+    index_free(d->ix);
+    free(d);
+    return NULL;
+  }
+
+  return d;
+}
+
+
+/* Function to apply the records appended to the edit log since it was
+ * last read to the index of the current dataset, matching entries by
+ * author and year as apply_log does, and return the number of records
+ * applied (or -1 on error). A record not yet completely written is left
+ * for the next call */
+int update_dataset(struct server *sv, struct dataset *d) {
+
+  struct stat sb;
+  struct thesis *t;
+  struct node *n;
+  unsigned char *log;
+  size_t off, len, size;
+  ssize_t got;
+  int fd, nrec=0, status=0;
+
+  fd = open(sv->logname, O_RDONLY);
+  if (fd < 0) return -1;
+  if ((fstat(fd, &sb) != 0) || (sb.st_size < sv->logoff) ||
+      ((log = malloc(sb.st_size - sv->logoff)) == NULL)) {
+    close(fd);
+    return -1;
+  }
+  size = sb.st_size - sv->logoff;
+  for (off=0; off<size; off+=got) {
+    got = pread(fd, log+off, size-off, sv->logoff+off);
+    if (got <= 0) break;
+  }
+  close(fd);
+  if (off < size) {
+    free(log);
+    return -1;
+  }
+
+  pthread_rwlock_wrlock(&d->rw);
+  for (off=0; (off < size) && check_record(log+off, size-off); off+=LOGHEADER+len) {
+    len = get_le32(log+off+4);
+    nrec++;
+    t = read_record(log+off);
+    if (t == NULL) continue;
+
+    n = index_find(d->ix, t);
+    if ((n != NULL) && (log[off+3] == 'A') && same_entry(&n->t, t)) {
+      free(t);
+      continue;
+    }
+    if ((n != NULL) && (log[off+3] != 'A')) index_delete(d->ix, n);
+    if ((log[off+3] != 'D') && match_filter(sv->filter, t) &&
+        (index_insert(d->ix, t) == NULL)) status = -1;
+    free(t);
+  }
+  pthread_rwlock_unlock(&d->rw);
+
+  sv->logoff += off;
+  free(log);
+
+  return (status == 0) ? nrec : -1;
+}
+
+
+/* Function to drop one reference to a dataset, freeing it after the
+ * last request using it has finished */
+void release_dataset(struct server *sv, struct dataset *d) {
+
+  int refs;
+
+  pthread_mutex_lock(&sv->lock);
+  refs = --d->refs;
+  pthread_mutex_unlock(&sv->lock);
+  if (refs > 0) return;
+
+  pthread_rwlock_destroy(&d->rw);
+  index_free(d->ix);
+  free(d);
+}
+
+
+/* Function to compare a node with a position in one of the orders of
+ * the index, given by a year, a collation key and the node at that
+ * position, whose entry ID and then address break ties between entries
+ * with the same key (a NULL node comes before all of them) */
+int compare_node(int order, struct node *n, const char *year, const unsigned char *key,
+                 const struct node *at) {
+
+  int c;
+
+  if (order == BYYEAR) {
+    c = strcmp(year, n->t.year);
+    if (c != 0) return c;
+  }
+  c = memcmp(n->t.key, key, KEYLEN);
+  if (c != 0) return c;
+  if (at == NULL) return 1;
+  if (n->t.id != at->t.id) return (n->t.id < at->t.id) ? -1 : 1;
+  if (n == at) return 0;
+
+  return ((uintptr_t)n < (uintptr_t)at) ? -1 : 1;
+}
+
+
+/* Function to create an empty index */
+struct index *index_create(void) {
+
+  struct index *ix;
+
+  ix = calloc(1, sizeof(struct index));
+  if (ix == NULL) return NULL;
+  ix->head = calloc(1, sizeof(struct node) + 2*MAXLEVEL*sizeof(struct node *));
+  if (ix->head == NULL) {
+    free(ix);
+    return NULL;
+  }
+  ix->head->next[BYAUTHOR] = ix->head->link;
+  ix->head->next[BYYEAR] = ix->head->link + MAXLEVEL;
+  ix->level[BYAUTHOR] = ix->level[BYYEAR] = 1;
+  ix->seed = 2463534242u;
+
+  return ix;
+}
+
+
+/* Function to find the last node at each level of one order that comes
+ * before a position, storing them in prev */
+void index_search(struct index *ix, int order, const char *year, const unsigned char *key,
+                  const struct node *at, struct node **prev) {
+
+  struct node *n = ix->head;
+  int lvl;
+
+  for (lvl=ix->level[order]-1; lvl>=0; lvl--) {
+    while ((n->next[order][lvl] != NULL) &&
+           (compare_node(order, n->next[order][lvl], year, key, at) < 0)) n = n->next[order][lvl];
+    prev[lvl] = n;
+  }
+}
+
+
+/* Function to choose the number of levels of a new node in one order,
+ * each level being used by a quarter of the nodes of the level below */
+int index_height(struct index *ix) {
+
+  int h = 1;
+
+  for (;;) {
+    ix->seed ^= ix->seed << 13;
+    ix->seed ^= ix->seed >> 17;
+    ix->seed ^= ix->seed << 5;
+    if (((ix->seed & 3) != 0) || (h == MAXLEVEL)) break;
+    h++;
+  }
+
+  return h;
+}
+
+
+/* Function to add a copy of an entry to both orders of the index,
+ * returning its node or NULL if out of memory */
+struct node *index_insert(struct index *ix, const struct thesis *t) {
+
+  struct node *n, *prev[MAXLEVEL];
+  int h[2], order, lvl;
+
+  h[BYAUTHOR] = index_height(ix);
+  h[BYYEAR] = index_height(ix);
+  n = malloc(sizeof(struct node) + (h[BYAUTHOR]+h[BYYEAR])*sizeof(struct node *));
+  if (n == NULL) return NULL;
+  n->t = *t;
+  n->next[BYAUTHOR] = n->link;
+  n->next[BYYEAR] = n->link + h[BYAUTHOR];
+
+  for (order=0; order<2; order++) {
+    index_search(ix, order, n->t.year, n->t.key, n, prev);
+    for (lvl=ix->level[order]; lvl<h[order]; lvl++) prev[lvl] = ix->head;
+    if (h[order] > ix->level[order]) ix->level[order] = h[order];
+    n->height[order] = h[order];
+    for (lvl=0; lvl<h[order]; lvl++) {
+      n->next[order][lvl] = prev[lvl]->next[order][lvl];
+      prev[lvl]->next[order][lvl] = n;
+    }
+  }
+  ix->num++;
+
+  return n;
+}
+
+
+/* Function to remove a node from both orders of the index and free it */
+void index_delete(struct index *ix, struct node *n) {
+
+  struct node *prev[MAXLEVEL];
+  int order, lvl;
+
+  for (order=0; order<2; order++) {
+    index_search(ix, order, n->t.year, n->t.key, n, prev);
+    for (lvl=0; lvl<n->height[order]; lvl++) prev[lvl]->next[order][lvl] = n->next[order][lvl];
+    while ((ix->level[order] > 1) && (ix->head->next[order][ix->level[order]-1] == NULL))
+      ix->level[order]--;
+  }
+  ix->num--;
+  free(n);
+}
+
+
+/* Function to return the first node in one order of the index at or
+ * after a year (ignored in author order) and collation key, from which
+ * a range is walked with node->next[order][0] */
+struct node *index_seek(struct index *ix, int order, const char *year, const unsigned char *key) {
+
+  struct node *prev[MAXLEVEL];
+
+  index_search(ix, order, year, key, NULL, prev);
+
+  return prev[0]->next[order][0];
+}
+
+
+/* Function to return the first node in one order of the index */
+struct node *index_first(struct index *ix, int order) {
+
+  return ix->head->next[order][0];
+}
+
+
+/* Function to return the node holding the entry with the same author
+ * and year as t, or NULL if there is none. Both are part of the key, so
+ * only the nodes with the same key are compared, and these are in order
+ * of ID, so of several such entries the one with the lowest ID is found
+ * as in apply_log() */
+struct node *index_find(struct index *ix, const struct thesis *t) {
+
+  struct node *n;
+
+  for (n=index_seek(ix, BYAUTHOR, NULL, t->key);
+       (n != NULL) && (memcmp(n->t.key, t->key, KEYLEN) == 0); n=n->next[BYAUTHOR][0]) {
+    if ((strcmp(n->t.author, t->author) == 0) && (strcmp(n->t.year, t->year) == 0)) return n;
+  }
+
+  return NULL;
+}
+
+
+/* Function to free an index and every node in it */
+void index_free(struct index *ix) {
+
+  struct node *n, *next;
+
+  if (ix == NULL) return;
+  for (n=ix->head->next[BYAUTHOR][0]; n!=NULL; n=next) {
+    next = n->next[BYAUTHOR][0];
+    free(n);
+  }
+  free(ix->head);
+  free(ix);
+}
+
+
+/* Function to return the latest modification time of the input files
+ * in nanoseconds, so that changes within the same second are seen. The
+ * edit log is left out, as records added to it are applied in place */
+long long input_mtime(struct server *sv) {
+
+  struct stat st;
+  long long mtime=0, t;
+  int i;
+
+  for (i=0; i<sv->nfile; i++) {
+    if (stat(sv->fname[i], &st) != 0) continue;
+    t = st.st_mtim.tv_sec*1000000000LL + st.st_mtim.tv_nsec;
+    if (t > mtime) mtime = t;
+  }
+
+  return mtime;
+}
+
+
+/* Function to answer connections taken from the queue (run by each
+ * thread in the server pool) */
+void *serve_thread(void *arg) {
+
+  struct server *sv = (struct server *)arg;
+  char *iobuf;
+  int fd;
+
+  iobuf = malloc(RESPBUF);
+  if (iobuf == NULL) return NULL;
+
+  for (;;) {
+    pthread_mutex_lock(&sv->lock);
+    while (sv->count == 0) pthread_cond_wait(&sv->ready, &sv->lock);
+    fd = sv->conn[sv->head];
+    sv->head = (sv->head + 1) % CONNQUEUE;
+    sv->count--;
+    pthread_cond_signal(&sv->space);
+    pthread_mutex_unlock(&sv->lock);
+
+    answer_request(sv, fd, iobuf);
+  }
+
+  return NULL;
+}
+
+
+/* Function to read one request from a connection, write the response
+ * through the thread's buffer and close the connection */
+void answer_request(struct server *sv, int fd, char *iobuf) {
+
+  struct timeval tv = {5, 0};
+  struct dataset *d;
+  struct query qry;
+  char req[REQLEN], *path, *query, *end;
+  size_t len=0;
+  ssize_t n;
+  FILE *fp;
+  int json;
+
+  /* Read the request line and headers, giving up on slow clients and on
+   * those that stop reading the response, which holds up edits */
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+  req[0] = 0;
+  while ((len < REQLEN-1) && (strstr(req, "\r\n\r\n") == NULL)) {
+    n = read(fd, req+len, REQLEN-1-len);
+    if (n <= 0) break;
+    len += n;
+    req[len] = 0;
+  }
+
+  fp = fdopen(fd, "w");
+  if (fp == NULL) {
+    close(fd);
+    return;
+  }
+  setvbuf(fp, iobuf, _IOFBF, RESPBUF);
+
+  if ((strncmp(req, "GET ", 4) != 0) || ((end = strchr(req+4, ' ')) == NULL)) {
+    fprintf(fp, "HTTP/1.1 %s\r\nContent-Type: text/plain\r\nConnection: close\r\n\r\n%s\n",
+            (strchr(req, ' ') == NULL) ? "400 Bad Request" : "405 Method Not Allowed",
+            "Only GET requests are answered.");
+    fclose(fp);
+    return;
+  }
+  *end = 0;
+  path = req+4;
+  query = strchr(path, '?');
+  if (query != NULL) *query++ = 0;
+  parse_query(query, &qry);
+  json = (strcmp(qry.format, "json") == 0);
+
+  if ((strcmp(path, "/") != 0) && (strcmp(path, "/facets") != 0)) {
+    fprintf(fp, "HTTP/1.1 404 Not Found\r\nContent-Type: text/plain\r\nConnection: close\r\n\r\n");
+    fprintf(fp, "Not found: %s\n", path);
+    fclose(fp);
+    return;
+  }
+
+  /* Hold the current entries until the response is written */
+  pthread_mutex_lock(&sv->lock);
+  d = sv->data;
+  d->refs++;
+  pthread_mutex_unlock(&sv->lock);
+
+  fprintf(fp, "HTTP/1.1 200 OK\r\nContent-Type: %s; charset=utf-8\r\nConnection: close\r\n\r\n",
+          json ? "application/json" : "text/html");
+  if (!json) {
+    fprintf(fp, "<!DOCTYPE html>\n<html>\n<head>\n  <meta charset=\"utf-8\">\n");
+    fprintf(fp, "  <title>SuperDARN Theses &amp; Dissertations</title>\n</head>\n<body>\n");
+    fprintf(fp, "<form action=\"/\">\n  <input name=\"q\" value=\"");
+    write_escaped(fp, qry.q);
+    fprintf(fp, "\">\n  <input type=\"submit\" value=\"Search\">\n</form>\n\n");
+  }
+  pthread_rwlock_rdlock(&d->rw);
+  if (strcmp(path, "/facets") == 0) write_facets(fp, d, &qry);
+  else write_list(fp, d, &qry);
+  pthread_rwlock_unlock(&d->rw);
+  if (!json) fprintf(fp, "</body>\n</html>\n");
+
+  fclose(fp);
+  release_dataset(sv, d);
+}
+
+
+/* Function to split a query string into its parameters, decoding %xx
+ * escapes and + signs in each value */
+void parse_query(char *str, struct query *qry) {
+
+  char *name, *value, *dst, *start, *src;
+  char hex[3] = {0, 0, 0};
+
+  memset(qry, 0, sizeof(struct query));
+  qry->limit = -1;
+
+  while ((str != NULL) && (*str != '\0')) {
+    name = str;
+    str = strchr(str, '&');
+    if (str != NULL) *str++ = 0;
+    value = strchr(name, '=');
+    if (value == NULL) continue;
+    *value++ = 0;
+
+    dst = NULL;
+    if (strcmp(name, "q") == 0) dst = qry->q;
+    else if (strcmp(name, "year") == 0) dst = qry->year;
+    else if (strcmp(name, "degree") == 0) dst = qry->degree;
+    else if (strcmp(name, "advisor") == 0) dst = qry->advisor;
+    else if (strcmp(name, "affiliation") == 0) dst = qry->affiliation;
+    else if (strcmp(name, "field") == 0) dst = qry->field;
+    else if (strcmp(name, "sort") == 0) dst = qry->sort;
+    else if (strcmp(name, "format") == 0) dst = qry->format;
+    else if (strcmp(name, "offset") == 0) qry->offset = atoi(value);
+    else if (strcmp(name, "limit") == 0) qry->limit = atoi(value);
+    if (dst == NULL) continue;
+
+    /* Each field holds at most STRLEN-1 decoded characters, and longer
+     * values are cut short */
+    for (src=value, start=dst; (*src != '\0') && (dst - start < STRLEN-1); src++) {
+      if (*src == '+') *dst++ = ' ';
+      else if ((*src == '%') && isxdigit((unsigned char)src[1]) && isxdigit((unsigned char)src[2])) {
+        hex[0] = src[1];
+        hex[1] = src[2];
+        *dst++ = strtol(hex, NULL, 16);
+        src += 2;
+      } else *dst++ = *src;
+    }
+    *dst = 0;
+  }
+  if (qry->offset < 0) qry->offset = 0;
+}
+
+
+/* Function to check whether an entry passes every filter of a query */
+int match_entry(struct thesis *t, struct query *qry) {
+
+  if ((qry->q[0] != '\0') && (strcasestr(t->author, qry->q) == NULL) &&
+      (strcasestr(t->title, qry->q) == NULL) && (strcasestr(t->advisor, qry->q) == NULL) &&
+      (strcasestr(t->affiliation, qry->q) == NULL)) return 0;
+  if ((qry->year[0] != '\0') && (strcmp(t->year, qry->year) != 0)) return 0;
+  if ((qry->degree[0] != '\0') && (strcasecmp(t->degree, qry->degree) != 0)) return 0;
+  if ((qry->advisor[0] != '\0') && (strcasestr(t->advisor, qry->advisor) == NULL)) return 0;
+  if ((qry->affiliation[0] != '\0') && (strcasestr(t->affiliation, qry->affiliation) == NULL)) return 0;
+
+  return 1;
+}
+
+
+/* Function to write the entries matching a query in the order asked for */
+void write_list(FILE *fp, struct dataset *d, struct query *qry) {
+
+  static const unsigned char lowest[KEYLEN];
+  struct thesis *t;
+  struct node *n;
+  int cnt=0, shown=0, ms_cnt=0, phd_cnt=0;
+  int json = (strcmp(qry->format, "json") == 0);
+  int order = (strcmp(qry->sort, "year") == 0) ? BYYEAR : BYAUTHOR;
+
+  if (json) fprintf(fp, "{\"items\": [");
+  else fprintf(fp, "<div align=\"center\">\n\n");
+
+  /* Walk only the entries of the year asked for when in year order */
+  if ((order == BYYEAR) && (qry->year[0] != '\0')) n = index_seek(d->ix, order, qry->year, lowest);
+  else n = index_first(d->ix, order);
+
+  for (; n!=NULL; n=n->next[order][0]) {
+    t = &n->t;
+    if ((order == BYYEAR) && (qry->year[0] != '\0') && (strcmp(t->year, qry->year) != 0)) break;
+    if (!match_entry(t, qry)) continue;
+    if (strcmp(t->degree, "MS") == 0) ms_cnt++;
+    else if (strcmp(t->degree, "PhD") == 0) phd_cnt++;
+    if ((cnt++ < qry->offset) || ((qry->limit >= 0) && (shown >= qry->limit))) continue;
+
+    if (json) {
+      if (shown == 0) PUT_LIT(fp, "\n");
+      else PUT_LIT(fp, ",\n");
+      write_json_entry(fp, t);
+    } else write_entry(fp, t);
+    shown++;
+  }
+
+  if (json) fprintf(fp, "\n], \"total\": %d, \"ms\": %d, \"phd\": %d}\n", cnt, ms_cnt, phd_cnt);
+  else write_footer(fp, cnt, ms_cnt, phd_cnt);
+}
+
+
+/* Function to write the number of entries matching a query with each
+ * value of the requested field */
+void write_facets(FILE *fp, struct dataset *d, struct query *qry) {
+
+  struct node *nd;
+  const char **value;
+  int i, j, n=0, k=0;
+  int json = (strcmp(qry->format, "json") == 0);
+  size_t off;
+
+  if (strcmp(qry->field, "year") == 0) off = offsetof(struct thesis, year);
+  else if (strcmp(qry->field, "degree") == 0) off = offsetof(struct thesis, degree);
+  else if (strcmp(qry->field, "advisor") == 0) off = offsetof(struct thesis, advisor);
+  else if (strcmp(qry->field, "affiliation") == 0) off = offsetof(struct thesis, affiliation);
+  else {
+    if (json) fprintf(fp, "{\"error\": \"unknown field\"}\n");
+    else fprintf(fp, "<p>Unknown field.</p>\n");
+    return;
+  }
+
+  /* Sort the values of the matching entries and count each run */
+  value = malloc((d->ix->num+1)*sizeof(char *));
+  if (value == NULL) return;
+  for (nd=index_first(d->ix, BYAUTHOR); nd!=NULL; nd=nd->next[BYAUTHOR][0]) {
+    if (match_entry(&nd->t, qry)) value[n++] = (const char *)&nd->t + off;
+  }
+  qsort(value, n, sizeof(char *), compare_string);
+
+  if (json) fprintf(fp, "{\"field\": \"%s\", \"values\": [", qry->field);
+  else fprintf(fp, "<table>\n");
+  for (i=0; i<n; i=j) {
+    for (j=i+1; (j < n) && (strcmp(value[i], value[j]) == 0); j++);
+    if (json) {
+      fprintf(fp, (k++ == 0) ? "\n  {\"value\": " : ",\n  {\"value\": ");
+      write_json(fp, value[i]);
+      fprintf(fp, ", \"count\": %d}", j-i);
+    } else {
+      fprintf(fp, "  <tr><td>");
+      write_escaped(fp, value[i]);
+      fprintf(fp, "</td><td>%d</td></tr>\n", j-i);
+    }
+  }
+  if (json) fprintf(fp, "\n]}\n");
+  else fprintf(fp, "</table>\n");
+
+  free(value);
+}
+
+
+/* Function to compare two strings through pointers to them */
+int compare_string(const void *s1, const void *s2) {
+
+  return strcmp(*(const char **)s1, *(const char **)s2);
+}
+
+
+/* Function to write a string as a quoted JSON string */
+void write_json(FILE *fp, const char *str) {
+
+  const unsigned char *p, *span;
+
+  fputc_unlocked('"', fp);
+  for (p=span=(const unsigned char *)str; ; p++) {
+    if ((*p >= 0x20) && (*p != '"') && (*p != '\\')) continue;
+    if (p > span) fwrite_unlocked(span, 1, p-span, fp);
+    if (*p == '\0') break;
+    if ((*p == '"') || (*p == '\\')) {
+      fputc_unlocked('\\', fp);
+      fputc_unlocked(*p, fp);
+    } else {
+      PUT_LIT(fp, "\\u00");
+      fputc_unlocked("0123456789abcdef"[*p >> 4], fp);
+      fputc_unlocked("0123456789abcdef"[*p & 15], fp);
+    }
+    span = p+1;
+  }
+  fputc_unlocked('"', fp);
+}
+
+
+/* Function to write an entry as a JSON object */
+void write_json_entry(FILE *fp, struct thesis *t) {
+
+  PUT_LIT(fp, "  {\"author\": ");
+  write_json(fp, t->author);
+  PUT_LIT(fp, ", \"year\": ");
+  write_json(fp, t->year);
+  PUT_LIT(fp, ", \"title\": ");
+  write_json(fp, t->title);
+  PUT_LIT(fp, ", \"advisor\": ");
+  write_json(fp, t->advisor);
+  PUT_LIT(fp, ", \"affiliation\": ");
+  write_json(fp, t->affiliation);
+  PUT_LIT(fp, ", \"degree\": ");
+  write_json(fp, t->degree);
+  PUT_LIT(fp, ", \"url\": ");
+  write_json(fp, t->url);
+  PUT_LIT(fp, ", \"id\": \"");
+  write_hex(fp, t->id);
+  PUT_LIT(fp, "\"}");
+}
+
+
+/* Function to write a CSV field, quoted (with quotes doubled) only if
+ * it holds a comma, quote or line break */
+void write_csv_field(FILE *fp, const char *str) {
+
+  const char *q;
+
+  if (strpbrk(str, ",\"\r\n") == NULL) {
+    fputs_unlocked(str, fp);
+    return;
+  }
+  fputc_unlocked('"', fp);
+  while ((q = strchr(str, '"')) != NULL) {
+    fwrite_unlocked(str, 1, q-str+1, fp);
+    fputc_unlocked('"', fp);
+    str = q+1;
+  }
+  fputs_unlocked(str, fp);
+  fputc_unlocked('"', fp);
+}
+
+
+/* Function to write an entry as a CSV row in the columns of CSVHEADER */
+void write_csv(FILE *fp, struct thesis *t) {
+
+  write_hex(fp, t->id);
+  fputc_unlocked(',', fp);
+  write_csv_field(fp, t->author);
+  fputc_unlocked(',', fp);
+  write_csv_field(fp, t->year);
+  fputc_unlocked(',', fp);
+  write_csv_field(fp, t->title);
+  fputc_unlocked(',', fp);
+  write_csv_field(fp, t->advisor);
+  fputc_unlocked(',', fp);
+  write_csv_field(fp, t->affiliation);
+  fputc_unlocked(',', fp);
+  write_csv_field(fp, t->degree);
+  fputc_unlocked(',', fp);
+  write_csv_field(fp, t->url);
+  PUT_LIT(fp, "\r\n");
+}
+
+
+/* Function to build a citation key for every entry from the folded
+ * last name of the author, the year and the first word of at least
+ * four letters in the title (eg, Thomas2012dynamics), adding a letter
+ * or number to any key already taken so that all keys are unique */
+int make_cite_keys(struct thesis *entry, int num, char (*cite)[CITELEN]) {
+
+  const unsigned char *p;
+  unsigned char c;
+  char base[CITELEN], *key;
+  int i, j, k, n, len, size, *set;
+  unsigned int h;
+
+  for (size=16; size < 2*num; size*=2);
+  set = malloc(sizeof(int)*size);
+  if (set == NULL) return -1;
+  for (i=0; i<size; i++) set[i] = -1;
+
+  for (i=0; i<num; i++) {
+
+    /* Last name, with the first letter capitalized */
+    n = 0;
+    for (p=(const unsigned char *)entry[i].author; (*p != '\0') && (*p != ',') && (n < 24); p++) {
+      if (fold_char(&p, &c) && (c < 0x80)) {
+        base[n] = (n == 0) ? toupper(c) : c;
+        n++;
+      }
+    }
+    if (n == 0) base[n++] = 'X';
+
+    for (p=(const unsigned char *)entry[i].year; isdigit(*p) && (n < 28); p++) base[n++] = *p;
+
+    /* First word of the title with at least four letters */
+    for (p=(const unsigned char *)entry[i].title; *p != '\0'; p++) {
+      for (len=0; isalpha(p[len]); len++);
+      if (len >= 4) {
+        for (j=0; (j < len) && (j < 16); j++) base[n++] = tolower(p[j]);
+        break;
+      }
+      p += len;
+      if (*p == '\0') break;
+    }
+    base[n] = 0;
+
+    /* Look for a free key in the hash set, trying a, b, ... and then
+     * numbers after the base key */
+    key = cite[i];
+    for (k=0; ; k++) {
+      if (k == 0) strcpy(key, base);
+      else if (k <= 26) sprintf(key, "%s%c", base, 'a'+k-1);
+      else sprintf(key, "%s-%d", base, k);
+
+      h = 2166136261u;
+      for (p=(const unsigned char *)key; *p != '\0'; p++) h = (h ^ *p) * 16777619u;
+      for (j=h & (size-1); (set[j] != -1) && (strcmp(cite[set[j]], key) != 0); j=(j+1) & (size-1));
+      if (set[j] == -1) {
+        set[j] = i;
+        break;
+      }
+    }
+  }
+
+  free(set);
+
+  return 0;
+}
+
+
+/* Function to split an affiliation into the institution and the place
+ * after its last comma */
+void split_affiliation(const char *affil, char *school, char *place) {
+
+  const char *comma = strrchr(affil, ',');
+
+  if (comma == NULL) {
+    strcpy(school, affil);
+    place[0] = 0;
+    return;
+  }
+  memcpy(school, affil, comma-affil);
+  school[comma-affil] = 0;
+  for (comma++; isspace((unsigned char)*comma); comma++);
+  strcpy(place, comma);
+}
+
+
+/* Function to write a string with the BibTeX special characters
+ * escaped, writing each run of plain characters with a single call */
+void put_bibtex(FILE *fp, const char *str) {
+
+  size_t n;
+
+  for (;;) {
+    n = strcspn(str, "&%$#_{}~^\\");
+    if (n > 0) fwrite_unlocked(str, 1, n, fp);
+    str += n;
+    if (*str == '\0') break;
+    if (*str == '\\') fputs_unlocked("\\textbackslash{}", fp);
+    else if (*str == '~') fputs_unlocked("\\textasciitilde{}", fp);
+    else if (*str == '^') fputs_unlocked("\\textasciicircum{}", fp);
+    else {
+      fputc_unlocked('\\', fp);
+      fputc_unlocked(*str, fp);
+    }
+    str++;
+  }
+}
+
+
+/* Function to write a BibTeX field if it is not empty */
+void put_bibfield(FILE *fp, const char *name, const char *pre, const char *value) {
+
+  if (value[0] == '\0') return;
+  fputs_unlocked(",\n  ", fp);
+  fputs_unlocked(name, fp);
+  fputs_unlocked(" = {", fp);
+  fputs_unlocked(pre, fp);
+  put_bibtex(fp, value);
+  fputc_unlocked('}', fp);
+}
+
+
+/* Function to write the url field if it is not empty. The url, hyperref
+ * and biblatex packages read it verbatim, so it is not escaped; only
+ * braces and backslashes, which would end the field early, are
+ * percent-encoded */
+void put_biburl(FILE *fp, const char *url) {
+
+  unsigned char c;
+  size_t n;
+
+  if (url[0] == '\0') return;
+  fputs_unlocked(",\n  url = {", fp);
+  for (;;) {
+    n = strcspn(url, "{}\\");
+    if (n > 0) fwrite_unlocked(url, 1, n, fp);
+    url += n;
+    if (*url == '\0') break;
+    c = (unsigned char)*url++;
+    fputc_unlocked('%', fp);
+    fputc_unlocked("0123456789ABCDEF"[c >> 4], fp);
+    fputc_unlocked("0123456789ABCDEF"[c & 15], fp);
+  }
+  fputc_unlocked('}', fp);
+}
+
+
+/* Function to write an entry as a BibTeX @phdthesis, @mastersthesis or
+ * @misc record */
+void write_bibtex(FILE *fp, struct thesis *t, const char *cite) {
+
+  char school[STRLEN], place[STRLEN];
+
+  split_affiliation(t->affiliation, school, place);
+
+  if (strcmp(t->degree, "PhD") == 0) fputs_unlocked("@phdthesis{", fp);
+  else if (strcmp(t->degree, "MS") == 0) fputs_unlocked("@mastersthesis{", fp);
+  else fputs_unlocked("@misc{", fp);
+  fputs_unlocked(cite, fp);
+  put_bibfield(fp, "author", "", t->author);
+  put_bibfield(fp, "title", "", t->title);
+  put_bibfield(fp, "school", "", school);
+  put_bibfield(fp, "address", "", place);
+  put_bibfield(fp, "year", "", t->year);
+  put_biburl(fp, t->url);
+  put_bibfield(fp, "note", "Advisor: ", t->advisor);
+  fputs_unlocked("\n}\n\n", fp);
+}
+
+
+/* Function to write an RIS tag if its value is not empty */
+void put_ris(FILE *fp, const char *tag, const char *value) {
+
+  if (value[0] == '\0') return;
+  fputs_unlocked(tag, fp);
+  fputs_unlocked("  - ", fp);
+  fputs_unlocked(value, fp);
+  fputs_unlocked("\r\n", fp);
+}
+
+
+/* Function to write an entry as an RIS THES record */
+void write_ris(FILE *fp, struct thesis *t, const char *cite) {
+
+  char school[STRLEN], place[STRLEN], note[STRLEN+16];
+  size_t len;
+
+  split_affiliation(t->affiliation, school, place);
+
+  put_ris(fp, "TY", "THES");
+  put_ris(fp, "ID", cite);
+  put_ris(fp, "AU", t->author);
+  put_ris(fp, "TI", t->title);
+  put_ris(fp, "PY", t->year);
+  put_ris(fp, "PB", school);
+  put_ris(fp, "CY", place);
+  if (t->degree[0] != '\0') {
+    strcpy(note, t->degree);
+    strcat(note, " thesis");
+    put_ris(fp, "M3", note);
+  }
+  put_ris(fp, "UR", t->url);
+  if (t->advisor[0] != '\0') {
+    len = strnlen(t->advisor, STRLEN-1);
+    memcpy(note, "Advisor: ", 9);
+    memcpy(note+9, t->advisor, len);
+    note[9+len] = 0;
+    put_ris(fp, "N1", note);
+  }
+  fputs_unlocked("ER  - \r\n\r\n", fp);
+}
+
+
+/* Function to write a CSL-JSON field if its value is not empty */
+void put_csl(FILE *fp, const char *name, const char *value) {
+
+  if (value[0] == '\0') return;
+  fputs_unlocked(", \"", fp);
+  fputs_unlocked(name, fp);
+  fputs_unlocked("\": ", fp);
+  write_json(fp, value);
+}
+
+
+/* Function to write an entry as a CSL-JSON thesis item */
+void write_csl(FILE *fp, struct thesis *t, const char *cite) {
+
+  char school[STRLEN], place[STRLEN], family[STRLEN+16], genre[STRLEN+8];
+  size_t len;
+  const char *given = strchr(t->author, ',');
+
+  split_affiliation(t->affiliation, school, place);
+  if (given == NULL) {
+    strcpy(family, t->author);
+    given = "";
+  } else {
+    memcpy(family, t->author, given-t->author);
+    family[given-t->author] = 0;
+    for (given++; isspace((unsigned char)*given); given++);
+  }
+
+  fputs_unlocked("  {\"id\": ", fp);
+  write_json(fp, cite);
+  fputs_unlocked(", \"type\": \"thesis\"", fp);
+  if (t->degree[0] != '\0') {
+    strcpy(genre, t->degree);
+    strcat(genre, " thesis");
+    put_csl(fp, "genre", genre);
+  }
+  fputs_unlocked(", \"author\": [{\"family\": ", fp);
+  write_json(fp, family);
+  if (given[0] != '\0') {
+    fputs_unlocked(", \"given\": ", fp);
+    write_json(fp, given);
+  }
+  fputs_unlocked("}]", fp);
+  put_csl(fp, "title", t->title);
+  put_csl(fp, "publisher", school);
+  put_csl(fp, "publisher-place", place);
+  if (isdigit((unsigned char)t->year[0])) {
+    fputs_unlocked(", \"issued\": {\"date-parts\": [[", fp);
+    fwrite_unlocked(t->year, 1, strspn(t->year, "0123456789"), fp);
+    fputs_unlocked("]]}", fp);
+  }
+  put_csl(fp, "URL", t->url);
+  if (t->advisor[0] != '\0') {
+    fputs_unlocked(", \"note\": ", fp);
+    len = strnlen(t->advisor, STRLEN-1);
+    memcpy(family, "Advisor: ", 9);
+    memcpy(family+9, t->advisor, len);
+    family[9+len] = 0;
+    write_json(fp, family);
+  }
+  fputs_unlocked("}", fp);
+}
+
+
+/* Function to take chunks of entries from the shared counter and write
+ * them to memory until none are left (run by each thread in the pool) */
+void *export_thread(void *arg) {
+
+  struct export *x = (struct export *)arg;
+  FILE *fp;
+  int chunk, i, first, last;
+
+  for (;;) {
+    pthread_mutex_lock(&x->lock);
+    chunk = x->next++;
+    pthread_mutex_unlock(&x->lock);
+    if (chunk >= x->nchunk) break;
+
+    fp = open_memstream(&x->buf[chunk], &x->size[chunk]);
+    if (fp == NULL) {
+      pthread_mutex_lock(&x->lock);
+      x->errors++;
+      pthread_mutex_unlock(&x->lock);
+      continue;
+    }
+    first = chunk*CHUNKSIZE;
+    last = (chunk+1)*CHUNKSIZE;
+    if (last > x->num) last = x->num;
+
+    /* Choose the format once for the whole chunk, so the loop over its
+     * entries only calls the writer for that format */
+    switch (x->format) {
+      case BIBTEX:
+        for (i=first; i<last; i++) write_bibtex(fp, &x->entry[i], x->cite[i]);
+        break;
+      case RIS:
+        for (i=first; i<last; i++) write_ris(fp, &x->entry[i], x->cite[i]);
+        break;
+      case CSLJSON:
+        for (i=first; i<last; i++) {
+          if (i > 0) PUT_LIT(fp, ",\n");
+          write_csl(fp, &x->entry[i], x->cite[i]);
+        }
+        break;
+      case JSON:
+        for (i=first; i<last; i++) {
+          if (i > 0) PUT_LIT(fp, ",\n");
+          write_json_entry(fp, &x->entry[i]);
+        }
+        break;
+      case CSV:
+        for (i=first; i<last; i++) write_csv(fp, &x->entry[i]);
+        break;
+    }
+    if (fclose(fp) != 0) {
+      pthread_mutex_lock(&x->lock);
+      x->errors++;
+      pthread_mutex_unlock(&x->lock);
+    }
+  }
+
+  return NULL;
+}
+
+
+/* Function to write every entry to stdout as BibTeX, RIS, CSL-JSON,
+ * JSON or CSV, rendering chunks of entries in parallel and writing them
+ * in order */
+int write_export(struct thesis *entry, int num, const char *format, int nthread) {
+
+  struct export x;
+  pthread_t *thread;
+  int i, status=-1;
+
+  if (strcmp(format, "bibtex") == 0) x.format = BIBTEX;
+  else if (strcmp(format, "ris") == 0) x.format = RIS;
+  else if (strcmp(format, "csl-json") == 0) x.format = CSLJSON;
+  else if (strcmp(format, "json") == 0) x.format = JSON;
+  else if (strcmp(format, "csv") == 0) x.format = CSV;
+  else {
+    fprintf(stderr, "Unknown export format: %s\n", format);
+    return -1;
+  }
+
+  x.entry = entry;
+  x.num = num;
+  x.nchunk = (num + CHUNKSIZE - 1) / CHUNKSIZE;
+  x.next = 0;
+  x.errors = 0;
+  x.cite = malloc(sizeof(x.cite[0])*(num+1));
+  x.buf = calloc(x.nchunk+1, sizeof(char *));
+  x.size = calloc(x.nchunk+1, sizeof(size_t));
+  thread = malloc(sizeof(pthread_t)*nthread);
+  if ((x.cite == NULL) || (x.buf == NULL) || (x.size == NULL) || (thread == NULL) ||
+      (make_cite_keys(entry, num, x.cite) == -1)) {
+    fprintf(stderr, "Failed to allocate memory for export.\n");
+    goto fail;
+  }
+
+  /* Render chunks on a pool of threads */
+  if (nthread > x.nchunk) nthread = x.nchunk;
+  pthread_mutex_init(&x.lock, NULL);
+  for (i=0; i<nthread; i++) {
+    if (pthread_create(&thread[i], NULL, export_thread, &x) != 0) break;
+  }
+  if (i == 0) export_thread(&x);
+  nthread = i;
+  for (i=0; i<nthread; i++) pthread_join(thread[i], NULL);
+  pthread_mutex_destroy(&x.lock);
+
+  /* Write nothing unless every chunk was rendered, rather than a
+   * truncated JSON array or CSV table */
+  if (x.errors > 0) {
+    fprintf(stderr, "Failed to export %d chunks of entries.\n", x.errors);
+    goto fail;
+  }
+
+  if ((x.format == CSLJSON) || (x.format == JSON)) fputs("[\n", stdout);
+  else if (x.format == CSV) fputs(CSVHEADER, stdout);
+  for (i=0; i<x.nchunk; i++) fwrite(x.buf[i], 1, x.size[i], stdout);
+  if ((x.format == CSLJSON) || (x.format == JSON)) fputs("\n]\n", stdout);
+  status = 0;
+
+fail:
+  if (x.buf != NULL) for (i=0; i<x.nchunk; i++) free(x.buf[i]);
+  free(x.cite);
+  free(x.buf);
+  free(x.size);
+  free(thread);
+
+  return status;
+}
+
+
+/* Function to order entries in a feed by year, most recent first, and
+ * then by their collation keys (for use with qsort) */
+int compare_recent(const void *s1, const void *s2) {
+  struct recent *r1 = (struct recent *)s1;
+  struct recent *r2 = (struct recent *)s2;
+
+  if (r1->year != r2->year) return (r1->year > r2->year) ? -1 : 1;
+  return memcmp(r1->t->key, r2->t->key, KEYLEN);
+}
+
+
+/* Function to move an entry down the feed heap until neither of its
+ * children would come after it in the feed */
+void sift_recent(struct recent *heap, int n, int i) {
+
+  struct recent tmp;
+  int c;
+
+  for (c=2*i+1; c<n; i=c, c=2*i+1) {
+    if ((c+1 < n) && (compare_recent(&heap[c+1], &heap[c]) > 0)) c++;
+    if (compare_recent(&heap[c], &heap[i]) <= 0) break;
+    tmp = heap[i];
+    heap[i] = heap[c];
+    heap[c] = tmp;
+  }
+}
+
+
+/* Function to write a date as an RFC 3339 (Atom) or RFC 822 (RSS)
+ * timestamp for the first day of the year */
+void write_date(FILE *fp, int year, int rss) {
+
+  struct tm tm;
+  time_t sec;
+  char str[64];
+
+  memset(&tm, 0, sizeof(tm));
+  tm.tm_year = year - 1900;
+  tm.tm_mday = 1;
+  sec = timegm(&tm);
+  gmtime_r(&sec, &tm);
+  strftime(str, sizeof(str), rss ? "%a, %d %b %Y %H:%M:%S GMT" : "%Y-%m-%dT%H:%M:%SZ", &tm);
+  fputs(str, fp);
+}
+
+
+/* Function to write the N most recent entries as an Atom or RSS feed,
+ * selecting them with a heap of N entries rather than sorting them all */
+int write_feed(struct thesis *entry, int num, const char *format, int size,
+               const char *link) {
+
+  struct recent *heap, r;
+  char id[STRLEN];
+  int i, j, n=0, rss;
+
+  if (strcmp(format, "rss") == 0) rss = 1;
+  else if (strcmp(format, "atom") == 0) rss = 0;
+  else {
+    fprintf(stderr, "Unknown feed format: %s\n", format);
+    return -1;
+  }
+  if (rss && (link[0] == '\0')) {
+    fprintf(stderr, "An rss feed needs --feed-url for the link of its channel.\n");
+    return -1;
+  }
+
+  if (size < 1) size = 1;
+  heap = malloc(sizeof(struct recent)*size);
+  if (heap == NULL) {
+    fprintf(stderr, "Failed to allocate memory for feed.\n");
+    return -1;
+  }
+
+  /* Keep the N most recent entries so far in a heap with the least
+   * recent of them at the top, so most entries are rejected by a single
+   * comparison against it */
+  for (i=0; i<num; i++) {
+    r.year = atoi(entry[i].year);
+    r.t = &entry[i];
+    if (n < size) {
+      heap[n++] = r;
+      if (n == size) {
+        for (j=n/2-1; j>=0; j--) sift_recent(heap, n, j);
+      }
+    } else if (compare_recent(&r, &heap[0]) < 0) {
+      heap[0] = r;
+      sift_recent(heap, n, 0);
+    }
+  }
+  qsort(heap, n, sizeof(struct recent), compare_recent);
+
+  /* Write the feed header */
+  fprintf(stdout, "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n");
+  if (rss) {
+    fprintf(stdout, "<rss version=\"2.0\">\n<channel>\n");
+    fprintf(stdout, "  <title>SuperDARN Theses and Dissertations</title>\n");
+    fprintf(stdout, "  <link>");
+    write_escaped(stdout, link);
+    fprintf(stdout, "</link>\n");
+    fprintf(stdout, "  <description>The %d most recent SuperDARN theses and dissertations</description>\n", n);
+  } else {
+    fprintf(stdout, "<feed xmlns=\"http://www.w3.org/2005/Atom\">\n");
+    fprintf(stdout, "  <title>SuperDARN Theses and Dissertations</title>\n");
+    fprintf(stdout, "  <id>");
+    write_escaped(stdout, (link[0] != '\0') ? link : "urn:superdarn:theses");
+    fprintf(stdout, "</id>\n");
+    if (link[0] != '\0') {
+      fprintf(stdout, "  <link href=\"");
+      write_escaped(stdout, link);
+      fprintf(stdout, "\"/>\n");
+    }
+    fprintf(stdout, "  <updated>");
+    write_date(stdout, (n > 0) ? heap[0].year : 1970, 0);
+    fprintf(stdout, "</updated>\n");
+  }
+
+  /* Write each entry, identified by its ID */
+  for (i=0; i<n; i++) {
+    sprintf(id, "urn:superdarn:thesis:%016llx", (unsigned long long)heap[i].t->id);
+
+    fprintf(stdout, rss ? "  <item>\n" : "  <entry>\n");
+    fprintf(stdout, "    <title>");
+    write_escaped(stdout, heap[i].t->title);
+    fprintf(stdout, "</title>\n");
+
+    /* Link to the entry's anchor on the feed's page if it has no URL,
+     * as an atom entry with no content needs a link */
+    fprintf(stdout, rss ? "    <link>" : "    <link href=\"");
+    if (heap[i].t->url[0] != '\0') write_escaped(stdout, heap[i].t->url);
+    else {
+      write_escaped(stdout, link);
+      fprintf(stdout, "#r%016llx", (unsigned long long)heap[i].t->id);
+    }
+    fprintf(stdout, rss ? "</link>\n" : "\"/>\n");
+    if (rss) {
+      fprintf(stdout, "    <guid isPermaLink=\"false\">");
+      write_escaped(stdout, id);
+      fprintf(stdout, "</guid>\n    <pubDate>");
+      write_date(stdout, heap[i].year, 1);
+      fprintf(stdout, "</pubDate>\n    <description>");
+      write_escaped(stdout, heap[i].t->author);
+      fprintf(stdout, ", ");
+    } else {
+      fprintf(stdout, "    <id>");
+      write_escaped(stdout, id);
+      fprintf(stdout, "</id>\n    <updated>");
+      write_date(stdout, heap[i].year, 0);
+      fprintf(stdout, "</updated>\n    <author><name>");
+      write_escaped(stdout, heap[i].t->author);
+      fprintf(stdout, "</name></author>\n    <summary>");
+    }
+    if (heap[i].t->degree[0] != '\0') {
+      write_escaped(stdout, heap[i].t->degree);
+      fprintf(stdout, " thesis, ");
+    }
+    write_escaped(stdout, heap[i].t->affiliation);
+    if (heap[i].t->advisor[0] != '\0') {
+      fprintf(stdout, " (Advisor: ");
+      write_escaped(stdout, heap[i].t->advisor);
+      fprintf(stdout, ")");
+    }
+    fprintf(stdout, rss ? "</description>\n  </item>\n" : "</summary>\n  </entry>\n");
+  }
+
+  fprintf(stdout, rss ? "</channel>\n</rss>\n" : "</feed>\n");
+
+  free(heap);
+
+  return 0;
+}
+
+
+/* Function to hash all of the fields of an entry with 64-bit FNV-1a */
+uint64_t hash_record(struct thesis *t) {
+
+  const char *field[NFIELD];
+  const unsigned char *p;
+  uint64_t h = 14695981039346656037ULL;
+  int i;
+
+  field[0] = t->author;
+  field[1] = t->year;
+  field[2] = t->title;
+  field[3] = t->advisor;
+  field[4] = t->affiliation;
+  field[5] = t->degree;
+  field[6] = t->url;
+
+  for (i=0; i<NFIELD; i++) {
+    for (p=(const unsigned char *)field[i]; *p != '\0'; p++) h = (h ^ *p) * 1099511628211ULL;
+    h = (h ^ '\n') * 1099511628211ULL;
+  }
+
+  return h;
+}
+
+
+/* Function to sort pointers to entries by their collation keys */
+int compare_ptr(const void *s1, const void *s2) {
+
+  return compare(*(struct thesis **)s1, *(struct thesis **)s2);
+}
+
+
+/* Function to write the entries that are new, updated or removed in a
+ * catalogue compared with an older version as an html fragment, and to
+ * report them to stderr. Entries are matched by a hash join on their
+ * IDs, so this takes linear time, and an entry with the same ID but any
+ * field changed (such as the case or punctuation of its title) is
+ * reported as updated */
+int diff_entries(struct thesis *old, int nold, struct thesis *cur, int ncur) {
+
+  struct thesis **added, **changed, **removed;
+  uint64_t *sum, s;
+  char *matched;
+  int *table, size, i, j, k, nadd=0, nchange=0, nremove=0;
+
+  for (size=16; size < 2*nold; size*=2);
+  table = malloc(sizeof(int)*size);
+  sum = malloc(sizeof(uint64_t)*(nold+1));
+  matched = calloc(nold+1, 1);
+  added = malloc(sizeof(struct thesis *)*(ncur+1));
+  changed = malloc(sizeof(struct thesis *)*(ncur+1));
+  removed = malloc(sizeof(struct thesis *)*(nold+1));
+  if ((table == NULL) || (sum == NULL) || (matched == NULL) ||
+      (added == NULL) || (changed == NULL) || (removed == NULL)) {
+    fprintf(stderr, "Failed to allocate memory for diff.\n");
+    return -1;
+  }
+
+  /* Build the hash table of old entries by ID */
+  for (j=0; j<size; j++) table[j] = -1;
+  for (i=0; i<nold; i++) {
+    sum[i] = hash_record(&old[i]);
+    for (j=old[i].id & (size-1); table[j] != -1; j=(j+1) & (size-1));
+    table[j] = i;
+  }
+
+  /* Probe it with each new entry, preferring an unmatched old entry
+   * with the same fields over one with only the same ID */
+  for (i=0; i<ncur; i++) {
+    s = hash_record(&cur[i]);
+    k = -1;
+    for (j=cur[i].id & (size-1); table[j] != -1; j=(j+1) & (size-1)) {
+      if ((old[table[j]].id != cur[i].id) || matched[table[j]]) continue;
+      if ((sum[table[j]] == s) && same_entry(&old[table[j]], &cur[i])) {
+        k = table[j];
+        break;
+      }
+      if (k == -1) k = table[j];
+    }
+
+    if (k == -1) added[nadd++] = &cur[i];
+    else {
+      matched[k] = 1;
+      if (!same_entry(&old[k], &cur[i])) changed[nchange++] = &cur[i];
+    }
+  }
+  for (i=0; i<nold; i++) if (!matched[i]) removed[nremove++] = &old[i];
+
+  qsort(added, nadd, sizeof(struct thesis *), compare_ptr);
+  qsort(changed, nchange, sizeof(struct thesis *), compare_ptr);
+  qsort(removed, nremove, sizeof(struct thesis *), compare_ptr);
+
+  /* Report the differences */
+  for (i=0; i<nadd; i++) fprintf(stderr, "+ %s (%s): %s\n", added[i]->author, added[i]->year, added[i]->title);
+  for (i=0; i<nchange; i++) fprintf(stderr, "~ %s (%s): %s\n", changed[i]->author, changed[i]->year, changed[i]->title);
+  for (i=0; i<nremove; i++) fprintf(stderr, "- %s (%s): %s\n", removed[i]->author, removed[i]->year, removed[i]->title);
+  fprintf(stderr, "%d added, %d updated, %d removed\n", nadd, nchange, nremove);
+
+  /* Write the html fragment */
+  fprintf(stdout, "<!-- *** BEGIN WHAT'S NEW HERE *** --!>\n");
+  fprintf(stdout, "<div align=\"center\">\n\n");
+  if (nadd > 0) {
+    fprintf(stdout, "  <h3>New theses and dissertations</h3>\n\n");
+    for (i=0; i<nadd; i++) write_entry(stdout, added[i]);
+  }
+  if (nchange > 0) {
+    fprintf(stdout, "  <h3>Updated theses and dissertations</h3>\n\n");
+    for (i=0; i<nchange; i++) write_entry(stdout, changed[i]);
+  }
+  if (nremove > 0) {
+    fprintf(stdout, "  <h3>Removed theses and dissertations</h3>\n\n  <ul>\n");
+    for (i=0; i<nremove; i++) {
+      fprintf(stdout, "    <li>");
+      write_escaped(stdout, removed[i]->author);
+      fprintf(stdout, " (");
+      write_escaped(stdout, removed[i]->year);
+      fprintf(stdout, "): ");
+      write_escaped(stdout, removed[i]->title);
+      fprintf(stdout, "</li>\n");
+    }
+    fprintf(stdout, "  </ul>\n\n");
+  }
+  fprintf(stdout, "  <center>%d new | %d updated | %d removed</center>\n\n", nadd, nchange, nremove);
+  fprintf(stdout, "</div>\n");
+  fprintf(stdout, "<!-- *** END WHAT'S NEW HERE *** --!>\n");
+
+  free(table);
+  free(sum);
+  free(matched);
+  free(added);
+  free(changed);
+  free(removed);
+
+  return 0;
+}
+
+
+/* Function to compile a template file once into a flat list of
+ * instructions: literal spans of the file, field references, and
+ * sections holding the index of their closing instruction. Returns -1
+ * after reporting the line of any error */
+int compile_template(const char *fname, struct tmpl *tp) {
+
+  struct tmpl_op *op;
+  char *p, *q, *tag, *end, name[STRLEN];
+  int stack[TMPLDEPTH], depth=0, loop=0, max=0, line=1, f;
+  size_t len, n;
+  FILE *fp;
+
+  memset(tp, 0, sizeof(struct tmpl));
+  fp = fopen(fname, "r");
+  if (fp == NULL) {
+    fprintf(stderr, "File not found: %s\n", fname);
+    return -1;
+  }
+  len = 0;
+  if (getdelim(&tp->src, &len, '\0', fp) < 0) {
+    fprintf(stderr, "Failed to read template: %s\n", fname);
+    fclose(fp);
+    return -1;
+  }
+  fclose(fp);
+
+  for (p=tp->src; *p != '\0'; p=end+2) {
+
+    if (tp->nop+2 > max) {
+      max = (max == 0) ? 64 : 2*max;
+      tp->op = realloc(tp->op, sizeof(struct tmpl_op)*max);
+      if (tp->op == NULL) return -1;
+    }
+
+    /* Literal text up to the next tag */
+    tag = strstr(p, "{{");
+    n = (tag == NULL) ? strlen(p) : (size_t)(tag-p);
+    if (n > 0) {
+      op = &tp->op[tp->nop++];
+      op->code = T_TEXT;
+      op->text = p;
+      op->len = n;
+      for (q=p; q<p+n; q++) if (*q == '\n') line++;
+    }
+    if (tag == NULL) break;
+
+    end = strstr(tag+2, "}}");
+    if (end == NULL) {
+      fprintf(stderr, "%s:%d: unterminated tag\n", fname, line);
+      return -1;
+    }
+
+    /* Name of the field or section, without spaces */
+    for (tag+=2; isspace((unsigned char)*tag); tag++);
+    n = (*tag == '#') || (*tag == '^') || (*tag == '/');
+    for (len=0; (tag+n+len < end) && !isspace((unsigned char)tag[n+len]) && (len < STRLEN-1); len++)
+      name[len] = tag[n+len];
+    name[len] = 0;
+
+    if (strcmp(name, "entries") == 0) f = F_ENTRIES;
+    else for (f=0; (f < NTMPLFIELD) && (strcmp(name, tmpl_fields[f]) != 0); f++);
+    if (f == NTMPLFIELD) {
+      fprintf(stderr, "%s:%d: unknown field: %s\n", fname, line, name);
+      return -1;
+    }
+    if ((f < F_COUNT) && !loop) {
+      fprintf(stderr, "%s:%d: %s used outside {{#entries}}\n", fname, line, name);
+      return -1;
+    }
+
+    op = &tp->op[tp->nop];
+    op->arg = f;
+    op->jump = 0;
+    if (*tag == '/') {
+      if ((depth == 0) || (tp->op[stack[depth-1]].arg != f)) {
+        fprintf(stderr, "%s:%d: unmatched {{/%s}}\n", fname, line, name);
+        return -1;
+      }
+      depth--;
+      if (f == F_ENTRIES) loop = 0;
+      tp->op[stack[depth]].jump = tp->nop;
+      op->code = T_END;
+    } else if ((*tag == '#') || (*tag == '^')) {
+      if (depth == TMPLDEPTH) {
+        fprintf(stderr, "%s:%d: sections nested too deeply\n", fname, line);
+        return -1;
+      }
+      if ((f == F_ENTRIES) && ((*tag == '^') || loop)) {
+        fprintf(stderr, "%s:%d: {{#entries}} cannot be inverted or nested\n", fname, line);
+        return -1;
+      }
+      if (f == F_ENTRIES) loop = 1;
+      stack[depth++] = tp->nop;
+      op->code = (f == F_ENTRIES) ? T_LOOP : (*tag == '#') ? T_IF : T_UNLESS;
+    } else if (f == F_ENTRIES) {
+      fprintf(stderr, "%s:%d: entries is only a section\n", fname, line);
+      return -1;
+    } else op->code = T_FIELD;
+    tp->nop++;
+  }
+
+  if (depth > 0) {
+    fprintf(stderr, "%s: unclosed {{#%s}}\n", fname,
+            (tp->op[stack[depth-1]].arg == F_ENTRIES) ? "entries" : tmpl_fields[tp->op[stack[depth-1]].arg]);
+    return -1;
+  }
+
+  return 0;
+}
+
+
+/* Function to append bytes to the output buffer, writing it out when
+ * it is full */
+void put_out(struct outbuf *ob, const char *str, size_t n) {
+
+  if (ob->len + n > OUTBUF) {
+    fwrite(ob->buf, 1, ob->len, ob->fp);
+    ob->len = 0;
+    if (n > OUTBUF) {
+      fwrite(str, 1, n, ob->fp);
+      return;
+    }
+  }
+  memcpy(ob->buf+ob->len, str, n);
+  ob->len += n;
+}
+
+
+/* Function to append a string to the output buffer with the html
+ * special characters escaped */
+void put_escaped(struct outbuf *ob, const char *str) {
+
+  size_t n;
+
+  for (;;) {
+    n = strcspn(str, "&<>\"'");
+    put_out(ob, str, n);
+    str += n;
+    switch (*str) {
+      case '&':  put_out(ob, "&amp;", 5); break;
+      case '<':  put_out(ob, "&lt;", 4); break;
+      case '>':  put_out(ob, "&gt;", 4); break;
+      case '"':  put_out(ob, "&quot;", 6); break;
+      case '\'': put_out(ob, "&#39;", 5); break;
+      default:   return;
+    }
+    str++;
+  }
+}
+
+
+/* Function to find the text of a template field for an entry (NULL
+ * outside the entries) and the totals, in a buffer if it is a number */
+const char *field_text(int f, struct thesis *t, struct thesis *prev, int *total, char *buf) {
+
+  char *field[NFIELD];
+  int letter;
+
+  switch (f) {
+    case F_ID:
+      sprintf(buf, "%016llx", (unsigned long long)t->id);
+      return buf;
+    case F_INITIAL:
+    case F_NEWINITIAL:
+      letter = fold_letter(t->author);
+      buf[0] = (letter == 0) ? 'A' : letter;
+      buf[1] = 0;
+      if ((f == F_NEWINITIAL) && (prev != NULL)) {
+        letter = fold_letter(prev->author);
+        if (((letter == 0) ? 'A' : letter) == buf[0]) buf[0] = 0;
+      }
+      return buf;
+    case F_COUNT:
+    case F_MS:
+    case F_PHD:
+      sprintf(buf, "%d", total[f-F_COUNT]);
+      return buf;
+    default:
+      entry_fields(t, field);
+      return field[f];
+  }
+}
+
+
+/* Function to run the instructions from start to end for an entry (or
+ * with t NULL outside the entries) */
+void run_template(struct tmpl *tp, int start, int end, struct thesis *entry, int num,
+                  struct thesis *t, struct thesis *prev, int *total, struct outbuf *ob) {
+
+  struct tmpl_op *op;
+  const char *str;
+  char buf[32];
+  int i, k;
+
+  for (i=start; i<end; i++) {
+    op = &tp->op[i];
+    switch (op->code) {
+      case T_TEXT:
+        put_out(ob, op->text, op->len);
+        break;
+      case T_FIELD:
+        put_escaped(ob, field_text(op->arg, t, prev, total, buf));
+        break;
+      case T_LOOP:
+        for (k=0; k<num; k++) {
+          run_template(tp, i+1, op->jump, entry, num, &entry[k], (k > 0) ? &entry[k-1] : NULL,
+                       total, ob);
+        }
+        i = op->jump;
+        break;
+      case T_IF:
+      case T_UNLESS:
+        str = field_text(op->arg, t, prev, total, buf);
+        if (((op->arg >= F_COUNT) ? (atoi(str) != 0) : (str[0] != '\0')) != (op->code == T_IF))
+          i = op->jump;
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+
+/* Function to write the entries to stdout through a compiled template */
+int write_template(struct thesis *entry, int num, const char *fname) {
+
+  struct tmpl tp;
+  struct outbuf *ob;
+  int i, total[3]={0, 0, 0};
+
+  if (compile_template(fname, &tp) == -1) {
+    free(tp.src);
+    free(tp.op);
+    return -1;
+  }
+  ob = malloc(sizeof(struct outbuf));
+  if (ob == NULL) return -1;
+  ob->len = 0;
+  ob->fp = stdout;
+
+  total[0] = num;
+  for (i=0; i<num; i++) {
+    if (strcmp(entry[i].degree, "MS") == 0) total[1]++;
+    else if (strcmp(entry[i].degree, "PhD") == 0) total[2]++;
+  }
+
+  run_template(&tp, 0, tp.nop, entry, num, NULL, NULL, total, ob);
+  fwrite(ob->buf, 1, ob->len, stdout);
+
+  free(ob);
+  free(tp.src);
+  free(tp.op);
+
+  return 0;
+}
+
+
+/* Function to compress finished pages taken from the queue into .gz
+ * files alongside them until the queue is closed (run on its own thread
+ * so that compression overlaps with rendering) */
+void *gz_thread(void *arg) {
+
+  struct gzqueue *q = (struct gzqueue *)arg;
+  struct gzjob job;
+  char path[2*STRLEN+4];
+  gzFile gz;
+  int status;
+
+  for (;;) {
+    pthread_mutex_lock(&q->lock);
+    while ((q->count == 0) && !q->done) pthread_cond_wait(&q->ready, &q->lock);
+    if (q->count == 0) {
+      pthread_mutex_unlock(&q->lock);
+      break;
+    }
+    job = q->job[q->head];
+    q->head = (q->head + 1) % GZQUEUE;
+    q->count--;
+    pthread_cond_signal(&q->space);
+    pthread_mutex_unlock(&q->lock);
+
+    sprintf(path, "%s.gz", job.path);
+    gz = gzopen(path, "wb9");
+    status = (gz == NULL) ? -1 : 0;
+    if ((status == 0) && (job.size > 0) && (gzwrite(gz, job.buf, job.size) != (int)job.size)) status = -1;
+    if ((gz != NULL) && (gzclose(gz) != Z_OK)) status = -1;
+    free(job.buf);
+
+    if (status != 0) {
+      pthread_mutex_lock(&q->lock);
+      q->errors++;
+      pthread_mutex_unlock(&q->lock);
+    }
+  }
+
+  return NULL;
+}
+
+
+/* Function to start the compression thread */
+int gz_start(struct gzqueue *q) {
+
+  q->head = q->count = q->done = q->errors = 0;
+  pthread_mutex_init(&q->lock, NULL);
+  pthread_cond_init(&q->ready, NULL);
+  pthread_cond_init(&q->space, NULL);
+
+  if (pthread_create(&q->thread, NULL, gz_thread, q) != 0) return -1;
+
+  return 0;
+}
+
+
+/* Function to queue a finished page for compression, waiting while the
+ * queue is full. The queue takes ownership of the page buffer */
+void gz_push(struct gzqueue *q, const char *path, char *buf, size_t size) {
+
+  struct gzjob *job;
+
+  pthread_mutex_lock(&q->lock);
+  while (q->count == GZQUEUE) pthread_cond_wait(&q->space, &q->lock);
+  job = &q->job[(q->head + q->count) % GZQUEUE];
+  strcpy(job->path, path);
+  job->buf = buf;
+  job->size = size;
+  q->count++;
+  pthread_cond_signal(&q->ready);
+  pthread_mutex_unlock(&q->lock);
+}
+
+
+/* Function to close the queue, wait for the remaining pages to be
+ * compressed and return the number that could not be written */
+int gz_finish(struct gzqueue *q) {
+
+  pthread_mutex_lock(&q->lock);
+  q->done = 1;
+  pthread_cond_signal(&q->ready);
+  pthread_mutex_unlock(&q->lock);
+
+  pthread_join(q->thread, NULL);
+  pthread_mutex_destroy(&q->lock);
+  pthread_cond_destroy(&q->ready);
+  pthread_cond_destroy(&q->space);
+
+  return q->errors;
 }
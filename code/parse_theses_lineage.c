@@ -0,0 +1,994 @@
+/* parse_theses_lineage.c
+   ======================
+   Author: E.G.Thomas (2019)
+
+   This program parses a text file containing SuperDARN thesis
+   and dissertation information and builds the advisor -> student
+   genealogy graph encoded by the advisor field. Co-advisors joined
+   by "," or "&" each receive a link to the student, and students
+   who later appear as advisors are matched using a normalized
+   name key (last name plus first initial). Each distinct name string
+   is split into last name, given names and initials only once, the
+   first time it is seen. The graph is stored in
+   compressed sparse row (CSR) form in both directions so that
+   academic descendants and ancestors can be found with a simple
+   breadth-first search. The program can be compiled with:
+
+        gcc -o parse_theses_lineage parse_theses_lineage.c
+
+   and then executed using:
+
+        ./parse_theses_lineage superdarn_theses.txt > lineage.html
+
+   The following options are also available:
+
+        --descendants "Name"  list academic descendants of Name
+        --ancestors "Name"    list academic ancestors of Name
+        --depth k             limit descendant/ancestor search to k
+                              generations (default: unlimited)
+        --top n               list the n largest lineages
+        --dot                 write the graph in Graphviz DOT format
+        --graphml             write the graph in GraphML format
+        --advisors            list each advisor with their number of
+                              students, and their own thesis if they
+                              were also a student
+
+   Names given to --descendants and --ancestors may be written as
+   either "Last, First" or "First Last".
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#define STRLEN 512
+
+/* Literal writer as in parse_theses.c, whose parsing and html escaping
+ * functions below are kept the same (check.sh compares them) */
+#define PUT_LIT(fp, s) fwrite_unlocked(s, 1, sizeof(s)-1, fp)
+
+/* Maximum number of lines kept for each entry */
+#define NSLOT 16
+
+/* Known degree types */
+char *degrees[] = {"MS", "PhD"};
+#define NDEGREE (sizeof(degrees)/sizeof(degrees[0]))
+#define KEYLEN 128
+#define NINITIAL 16
+
+struct thesis {
+  char author[STRLEN];
+  char year[STRLEN];
+  char title[STRLEN];
+  char advisor[STRLEN];
+  char affiliation[STRLEN];
+  char degree[STRLEN];
+  char url[STRLEN];
+};
+
+/* Name split into its parts, with the key used to match the same
+ * person written as an author and as an advisor */
+struct name {
+  char last[STRLEN];
+  char given[STRLEN];
+  char initials[NINITIAL];
+  char key[KEYLEN];
+};
+
+struct person {
+  struct name nm;
+  char name[STRLEN];
+  char year[NINITIAL], degree[NINITIAL];
+  int lineage;
+};
+
+struct graph {
+  struct person *node;
+  int nnode, maxnode;
+  int *hash;
+  int hashsize;
+
+  /* Name strings already parsed and the person each refers to */
+  char **alias;
+  int *alias_id;
+  int nalias, maxalias;
+  int *aliashash;
+  int aliashashsize;
+
+  int (*edge)[2];
+  int nedge, maxedge;
+
+  /* Advisor -> student (out) and student -> advisor (in) CSR arrays */
+  int *out_off, *out_adj;
+  int *in_off, *in_adj;
+};
+
+
+struct thesis *parse_text(FILE *fp, int *num, int (*keep)(struct thesis *, void *), void *arg);
+int is_year(const char *line);
+void assign_fields(struct thesis *t, char **line, int n);
+int build_graph(struct graph *g, struct thesis *entry, int num);
+unsigned int hash_string(const char *str);
+int parse_name(const char *name, struct name *nm, char *display);
+int lookup_key(struct graph *g, const char *key);
+int lookup_alias(struct graph *g, const char *name);
+int intern_person(struct graph *g, const char *name);
+int find_person(struct graph *g, const char *name);
+int search(int start, int depth, int *off, int *adj,
+           int *order, int *level);
+int compare_lineage(const void *s1, const void *s2);
+int compare_students(const void *s1, const void *s2);
+int write_list(struct graph *g, int start, int depth, int *off, int *adj,
+               const char *label);
+int write_top(struct graph *g, int top);
+int write_dot(struct graph *g);
+void write_escaped(FILE *fp, const char *str);
+void write_quoted(FILE *fp, const char *str);
+int write_graphml(struct graph *g);
+int write_html(struct graph *g);
+int write_advisors(struct graph *g);
+
+
+int main(int argc, char *argv[]) {
+
+  char fname[STRLEN];
+  FILE *fp;
+
+  struct thesis *entry=NULL;
+  struct graph g;
+  int num=0;
+
+  int i, id;
+  int depth=-1, top=0, dot=0, graphml=0, advisors=0;
+  char *desc=NULL, *anc=NULL;
+
+  strcpy(fname, "superdarn_theses.txt");
+
+  /* Get command line options and input filename */
+  for (i=1; i<argc; i++) {
+    if ((strcmp(argv[i], "--descendants") == 0) && (i+1 < argc)) desc = argv[++i];
+    else if ((strcmp(argv[i], "--ancestors") == 0) && (i+1 < argc)) anc = argv[++i];
+    else if ((strcmp(argv[i], "--depth") == 0) && (i+1 < argc)) depth = atoi(argv[++i]);
+    else if ((strcmp(argv[i], "--top") == 0) && (i+1 < argc)) top = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--dot") == 0) dot = 1;
+    else if (strcmp(argv[i], "--graphml") == 0) graphml = 1;
+    else if (strcmp(argv[i], "--advisors") == 0) advisors = 1;
+    else if (strncmp(argv[i], "--", 2) == 0) {
+      fprintf(stderr, "Unknown option: %s\n", argv[i]);
+      return (-1);
+    } else strcpy(fname, argv[i]);
+  }
+
+  /* Open input text file */
+  fp = fopen(fname, "r");
+  if (fp == NULL) {
+    fprintf(stderr, "File not found: %s\n", fname);
+    return (-1);
+  }
+
+  /* Parse input text file for information about each thesis/dissertation */
+  entry = parse_text(fp, &num, NULL, NULL);
+
+  /* Close input text file */
+  fclose(fp);
+
+  /* Check for error when parsing input text file */
+  if (num == -1) {
+    fprintf(stderr, "Failed to parse input text file.\n");
+    return (-1);
+  }
+
+  /* Build advisor -> student graph from advisor and author fields */
+  if (build_graph(&g, entry, num) == -1) {
+    fprintf(stderr, "Failed to build advisor graph.\n");
+    return (-1);
+  }
+  free(entry);
+
+  /* Answer descendant and ancestor queries */
+  if ((desc != NULL) || (anc != NULL)) {
+    if (desc != NULL) {
+      id = find_person(&g, desc);
+      if (id == -1) {
+        fprintf(stderr, "Name not found: %s\n", desc);
+        return (-1);
+      }
+      write_list(&g, id, depth, g.out_off, g.out_adj, "Descendants");
+    }
+    if (anc != NULL) {
+      id = find_person(&g, anc);
+      if (id == -1) {
+        fprintf(stderr, "Name not found: %s\n", anc);
+        return (-1);
+      }
+      write_list(&g, id, depth, g.in_off, g.in_adj, "Ancestors");
+    }
+    return (0);
+  }
+
+  /* Write graph or lineage page to stdout */
+  if (top > 0) write_top(&g, top);
+  else if (dot) write_dot(&g);
+  else if (graphml) write_graphml(&g);
+  else if (advisors) write_advisors(&g);
+  else write_html(&g);
+
+  return (0);
+}
+
+
+/* Function to parse a text file and store information about each
+ * thesis/dissertation in the appropriate field of a structure and
+ * return the number of entries found. An author line followed by a
+ * year line starts a new entry, so a missing or extra line only
+ * affects the entry it occurs in rather than every later entry. Each
+ * entry is passed to keep, if given, which returns 0 to drop it */
+struct thesis *parse_text(FILE *fp, int *num, int (*keep)(struct thesis *, void *), void *arg) {
+
+  struct thesis *entry=NULL, *grow;
+  char buf[NSLOT][STRLEN];
+  char *line[NSLOT], *tmp;
+  int i, c, n=0, cnt=0, max=0;
+  size_t len;
+
+  for (i=0; i<NSLOT; i++) line[i] = buf[i];
+
+  /* Read in each line of text file */
+  while (fgets(line[n], STRLEN, fp) != NULL) {
+
+    /* Trim \n at end of each line returned by fgets, discarding the rest
+     * of any line too long for a field rather than reading it as the next */
+    len = strcspn(line[n], "\r\n");
+    if ((line[n][len] == '\0') && (len == STRLEN-1)) {
+      while (((c = fgetc(fp)) != EOF) && (c != '\n'));
+    }
+    line[n][len] = 0;
+
+    /* Skip blank lines before the first field of an entry */
+    if ((n == 0) && (len == 0)) continue;
+
+    /* Store the previous entry when the next author and year are found */
+    if ((n >= 3) && (line[n-1][0] != '\0') && is_year(line[n])) {
+      if (cnt == max) {
+        max = (max == 0) ? 256 : 2*max;
+        grow = realloc(entry, sizeof(struct thesis)*max);
+        if (grow == NULL) {
+          free(entry);
+          *num = -1;
+          return NULL;
+        }
+        entry = grow;
+      }
+      assign_fields(&entry[cnt], line, n-1);
+      if ((keep == NULL) || keep(&entry[cnt], arg)) cnt++;
+
+      tmp = line[0]; line[0] = line[n-1]; line[n-1] = tmp;
+      tmp = line[1]; line[1] = line[n]; line[n] = tmp;
+      n = 2;
+      continue;
+    }
+
+    /* Advance to next line of entry. If an entry has far more lines than
+     * fields the second line of its title is dropped, keeping the fields
+     * after the title and the last lines read, which find the next
+     * author and year */
+    if (n < NSLOT-1) n++;
+    else {
+      tmp = line[3];
+      for (i=3; i<n; i++) line[i] = line[i+1];
+      line[n] = tmp;
+    }
+  }
+
+  /* Store the final entry */
+  if (n > 0) {
+    if (cnt == max) {
+      grow = realloc(entry, sizeof(struct thesis)*(max+1));
+      if (grow == NULL) {
+        free(entry);
+        *num = -1;
+        return NULL;
+      }
+      entry = grow;
+    }
+    assign_fields(&entry[cnt], line, n);
+    if ((keep == NULL) || keep(&entry[cnt], arg)) cnt++;
+  }
+
+  /* Return the number of thesis/dissertation entries read from file */
+  *num = cnt;
+
+  return entry;
+}
+
+
+/* Function to check whether a line holds a four-digit year */
+int is_year(const char *line) {
+  return isdigit((unsigned char)line[0]) && isdigit((unsigned char)line[1]) &&
+         isdigit((unsigned char)line[2]) && isdigit((unsigned char)line[3]) &&
+         (line[4] == '\0');
+}
+
+
+/* Function to assign the n lines of an entry to the fields of a structure.
+ * Well-formed entries have seven lines (eight with the blank separator),
+ * while shorter or longer entries are assigned by rule: a trailing line
+ * starting with "http" is the URL, a known degree type is the degree,
+ * extra lines after the title are joined to it (eg, a wrapped title), and
+ * a lone line between the title and degree is taken to be the affiliation
+ * if it contains a comma but no "&" and the advisor otherwise */
+void assign_fields(struct thesis *t, char **line, int n) {
+
+  int i, m;
+  char **f;
+
+  /* Strip trailing blank lines, which are separators or empty fields */
+  while ((n > 2) && (line[n-1][0] == '\0')) n--;
+
+  strcpy(t->author, line[0]);
+  strcpy(t->year, (n > 1) ? line[1] : "");
+  t->title[0] = t->advisor[0] = t->affiliation[0] = t->degree[0] = t->url[0] = 0;
+
+  f = line+2;
+  m = n-2;
+  if (m <= 0) return;
+
+  if ((strncmp(f[m-1], "http", 4) == 0) || (m == 5)) strcpy(t->url, f[--m]);
+  if (m == 0) return;
+
+  for (i=0; i<(int)NDEGREE; i++) if (strcmp(f[m-1], degrees[i]) == 0) break;
+  if ((i < (int)NDEGREE) || (m == 4)) strcpy(t->degree, f[--m]);
+
+  strcpy(t->title, f[0]);
+  if (m > 3) {
+    for (i=1; i<m-2; i++) {
+      strncat(t->title, " ", STRLEN-strlen(t->title)-1);
+      strncat(t->title, f[i], STRLEN-strlen(t->title)-1);
+    }
+    strcpy(t->advisor, f[m-2]);
+    strcpy(t->affiliation, f[m-1]);
+  } else if (m == 3) {
+    strcpy(t->advisor, f[1]);
+    strcpy(t->affiliation, f[2]);
+  } else if (m == 2) {
+    if ((strchr(f[1], ',') != NULL) && (strchr(f[1], '&') == NULL)) strcpy(t->affiliation, f[1]);
+    else strcpy(t->advisor, f[1]);
+  }
+}
+
+
+/* Function to split a name written as either "Last, First M." or
+ * "First M. Last" into its last name, given names and initials, build
+ * a normalized lookup key (folded last name and first initial) and a
+ * "First Last" display name, returning -1 if there is no name */
+int parse_name(const char *name, struct name *nm, char *display) {
+
+  char buf[STRLEN];
+  char *first, *last, *comma, *p;
+  int n=0, word=1;
+
+  strncpy(buf, name, STRLEN-1);
+  buf[STRLEN-1] = 0;
+
+  /* Trim leading and trailing whitespace */
+  first = buf;
+  while (isspace((unsigned char)*first)) first++;
+  p = first + strlen(first);
+  while ((p > first) && isspace((unsigned char)p[-1])) *--p = 0;
+
+  comma = strchr(first, ',');
+  if (comma != NULL) {
+    /* Author field: "Last, First M." */
+    *comma = 0;
+    last = first;
+    first = comma+1;
+    while (isspace((unsigned char)*first)) first++;
+    p = last + strlen(last);
+    while ((p > last) && isspace((unsigned char)p[-1])) *--p = 0;
+  } else {
+    /* Advisor field: "First M. Last" with the last name taken to be the
+     * final word plus any lowercase particles preceding it ("van Zyl") */
+    last = strrchr(first, ' ');
+    if (last == NULL) {
+      last = first;
+      first = "";
+    } else {
+      *last++ = 0;
+      while ((p = strrchr(first, ' ')) != NULL && islower((unsigned char)p[1])) {
+        last[-1] = ' ';
+        *p = 0;
+        last = p+1;
+      }
+      if (islower((unsigned char)first[0])) {
+        /* Whole remaining name is a particle; keep it with the last name */
+        last[-1] = ' ';
+        last = first;
+        first = "";
+      }
+    }
+  }
+  strcpy(nm->last, last);
+  strcpy(nm->given, first);
+  if (first[0] == '\0') strcpy(display, last);
+  else sprintf(display, "%s %s", first, last);
+
+  /* Initials from the first letter of each given name */
+  for (p=first; (*p != 0) && (n < NINITIAL-1); p++) {
+    if (word && isalpha((unsigned char)*p)) nm->initials[n++] = toupper((unsigned char)*p);
+    word = (isspace((unsigned char)*p) || (*p == '.') || (*p == '-'));
+  }
+  nm->initials[n] = 0;
+
+  /* Fold last name to lowercase, dropping punctuation and spaces */
+  n = 0;
+  for (p=last; (*p != 0) && (n < KEYLEN-3); p++) {
+    if (isalnum((unsigned char)*p) || ((unsigned char)*p >= 0x80))
+      nm->key[n++] = tolower((unsigned char)*p);
+  }
+  nm->key[n++] = ' ';
+  if (first[0] != '\0') nm->key[n++] = tolower((unsigned char)first[0]);
+  nm->key[n] = 0;
+
+  return (nm->key[0] == ' ') ? -1 : 0;
+}
+
+
+/* Function to return the FNV-1a hash of a string */
+unsigned int hash_string(const char *str) {
+
+  unsigned int h=2166136261u;
+
+  for (; *str != 0; str++) h = (h ^ (unsigned char)*str) * 16777619u;
+
+  return h;
+}
+
+
+/* Function to return the slot in the hash table holding a normalized
+ * name key, or the empty slot where it should be inserted */
+int lookup_key(struct graph *g, const char *key) {
+
+  int i;
+
+  /* FNV-1a hash of the normalized key into an open-addressed table */
+  for (i=hash_string(key) & (g->hashsize-1); g->hash[i] != -1; i=(i+1) & (g->hashsize-1)) {
+    if (strcmp(g->node[g->hash[i]].nm.key, key) == 0) break;
+  }
+
+  return i;
+}
+
+
+/* Function to return the slot in the alias table holding a name string
+ * exactly as written, or the empty slot where it should be inserted */
+int lookup_alias(struct graph *g, const char *name) {
+
+  int i;
+
+  for (i=hash_string(name) & (g->aliashashsize-1); g->aliashash[i] != -1;
+       i=(i+1) & (g->aliashashsize-1)) {
+    if (strcmp(g->alias[g->aliashash[i]], name) == 0) break;
+  }
+
+  return i;
+}
+
+
+/* Function to return the graph index of a person, adding them to the
+ * graph if they have not been seen before. Each name string is only
+ * parsed the first time it is seen, after which its index is found in
+ * the alias table */
+int intern_person(struct graph *g, const char *name) {
+
+  struct name nm;
+  char display[STRLEN];
+  int i, j, id;
+
+  i = lookup_alias(g, name);
+  if (g->aliashash[i] != -1) return g->alias_id[g->aliashash[i]];
+
+  id = -1;
+  if (parse_name(name, &nm, display) == 0) {
+    j = lookup_key(g, nm.key);
+    if (g->hash[j] != -1) {
+      /* Keep the most complete form of the name for display */
+      id = g->hash[j];
+      if (strlen(display) > strlen(g->node[id].name)) {
+        strcpy(g->node[id].name, display);
+        g->node[id].nm = nm;
+      }
+    } else {
+      if (g->nnode == g->maxnode) {
+        g->maxnode *= 2;
+        g->node = realloc(g->node, sizeof(struct person)*g->maxnode);
+      }
+      id = g->nnode++;
+      g->node[id].nm = nm;
+      strcpy(g->node[id].name, display);
+      g->node[id].year[0] = g->node[id].degree[0] = 0;
+      g->node[id].lineage = 0;
+      g->hash[j] = id;
+
+      /* Grow hash table to keep the load factor below one half */
+      if (2*g->nnode > g->hashsize) {
+        free(g->hash);
+        g->hashsize *= 2;
+        g->hash = malloc(sizeof(int)*g->hashsize);
+        for (j=0; j<g->hashsize; j++) g->hash[j] = -1;
+        for (j=0; j<g->nnode; j++) g->hash[lookup_key(g, g->node[j].nm.key)] = j;
+      }
+    }
+  }
+
+  /* Remember the string, including strings that hold no name */
+  if (g->nalias == g->maxalias) {
+    g->maxalias *= 2;
+    g->alias = realloc(g->alias, sizeof(char *)*g->maxalias);
+    g->alias_id = realloc(g->alias_id, sizeof(int)*g->maxalias);
+  }
+  g->alias[g->nalias] = strdup(name);
+  g->alias_id[g->nalias] = id;
+  g->aliashash[i] = g->nalias++;
+
+  if (2*g->nalias > g->aliashashsize) {
+    free(g->aliashash);
+    g->aliashashsize *= 2;
+    g->aliashash = malloc(sizeof(int)*g->aliashashsize);
+    for (j=0; j<g->aliashashsize; j++) g->aliashash[j] = -1;
+    for (j=0; j<g->nalias; j++) g->aliashash[lookup_alias(g, g->alias[j])] = j;
+  }
+
+  return id;
+}
+
+
+/* Function to look up a person by name without adding them to the graph */
+int find_person(struct graph *g, const char *name) {
+
+  struct name nm;
+  char display[STRLEN];
+
+  if (parse_name(name, &nm, display) == -1) return -1;
+
+  return g->hash[lookup_key(g, nm.key)];
+}
+
+
+/* Function to sort edges by advisor and then by student (for use with qsort) */
+int compare_edge(const void *s1, const void *s2) {
+  const int *e1 = (const int *)s1;
+  const int *e2 = (const int *)s2;
+
+  if (e1[0] != e2[0]) return (e1[0] < e2[0]) ? -1 : +1;
+  if (e1[1] != e2[1]) return (e1[1] < e2[1]) ? -1 : +1;
+  return 0;
+}
+
+
+/* Function to build compressed sparse row arrays from a sorted edge list,
+ * using column c of each edge as the source and the other as the target */
+void build_csr(struct graph *g, int c, int **off, int **adj) {
+
+  int i;
+
+  *off = calloc(g->nnode+1, sizeof(int));
+  *adj = malloc(sizeof(int)*(g->nedge+1));
+
+  for (i=0; i<g->nedge; i++) (*off)[g->edge[i][c]+1]++;
+  for (i=0; i<g->nnode; i++) (*off)[i+1] += (*off)[i];
+  for (i=0; i<g->nedge; i++) (*adj)[(*off)[g->edge[i][c]]++] = g->edge[i][1-c];
+
+  /* Shift offsets back after using them as insertion cursors */
+  for (i=g->nnode; i>0; i--) (*off)[i] = (*off)[i-1];
+  (*off)[0] = 0;
+}
+
+
+/* Function to split each advisor field into individual names and
+ * build the advisor -> student graph */
+int build_graph(struct graph *g, struct thesis *entry, int num) {
+
+  char advisor[STRLEN];
+  char *name, *amp;
+  int i, j, cnt, student, adv;
+  int *order, *level;
+
+  g->nnode = 0;
+  g->maxnode = 256;
+  g->node = malloc(sizeof(struct person)*g->maxnode);
+  g->hashsize = 1024;
+  g->hash = malloc(sizeof(int)*g->hashsize);
+  for (i=0; i<g->hashsize; i++) g->hash[i] = -1;
+  g->nalias = 0;
+  g->maxalias = 256;
+  g->alias = malloc(sizeof(char *)*g->maxalias);
+  g->alias_id = malloc(sizeof(int)*g->maxalias);
+  g->aliashashsize = 1024;
+  g->aliashash = malloc(sizeof(int)*g->aliashashsize);
+  for (i=0; i<g->aliashashsize; i++) g->aliashash[i] = -1;
+  g->nedge = 0;
+  g->maxedge = 256;
+  g->edge = malloc(sizeof(int[2])*g->maxedge);
+
+  if ((g->node == NULL) || (g->hash == NULL) || (g->edge == NULL) ||
+      (g->alias == NULL) || (g->alias_id == NULL) || (g->aliashash == NULL)) return -1;
+
+  for (i=0; i<num; i++) {
+    student = intern_person(g, entry[i].author);
+    if (student == -1) continue;
+
+    /* Keep the latest thesis of each student */
+    if (strcmp(entry[i].year, g->node[student].year) >= 0) {
+      strncpy(g->node[student].year, entry[i].year, NINITIAL-1);
+      strncpy(g->node[student].degree, entry[i].degree, NINITIAL-1);
+      g->node[student].year[NINITIAL-1] = g->node[student].degree[NINITIAL-1] = 0;
+    }
+
+    /* Co-advisors are separated by ", " and " & " */
+    strcpy(advisor, entry[i].advisor);
+    while ((amp = strchr(advisor, '&')) != NULL) *amp = ',';
+
+    for (name=strtok(advisor, ","); name != NULL; name=strtok(NULL, ",")) {
+      adv = intern_person(g, name);
+      if ((adv == -1) || (adv == student)) continue;
+
+      if (g->nedge == g->maxedge) {
+        g->maxedge *= 2;
+        g->edge = realloc(g->edge, sizeof(int[2])*g->maxedge);
+      }
+      g->edge[g->nedge][0] = adv;
+      g->edge[g->nedge][1] = student;
+      g->nedge++;
+    }
+  }
+
+  /* Remove repeated links (eg, MS and PhD with the same advisor) */
+  qsort(g->edge, g->nedge, sizeof(int[2]), compare_edge);
+  for (i=0, j=0; i<g->nedge; i++) {
+    if ((j > 0) && (compare_edge(g->edge[i], g->edge[j-1]) == 0)) continue;
+    g->edge[j][0] = g->edge[i][0];
+    g->edge[j][1] = g->edge[i][1];
+    j++;
+  }
+  g->nedge = j;
+
+  build_csr(g, 0, &g->out_off, &g->out_adj);
+  build_csr(g, 1, &g->in_off, &g->in_adj);
+
+  /* Count the size of each person's lineage (all descendants) */
+  order = malloc(sizeof(int)*g->nnode);
+  level = malloc(sizeof(int)*g->nnode);
+  for (i=0; i<g->nnode; i++) level[i] = -1;
+  for (i=0; i<g->nnode; i++) {
+    cnt = search(i, -1, g->out_off, g->out_adj, order, level);
+    g->node[i].lineage = cnt - 1;
+    for (j=0; j<cnt; j++) level[order[j]] = -1;
+  }
+  free(order);
+  free(level);
+
+  return 0;
+}
+
+
+/* Function to perform a breadth-first search from start following the
+ * given CSR arrays up to depth generations (or all if depth < 0). The
+ * visited nodes are returned in order along with their level, and the
+ * level array must be initialized to -1 for all nodes beforehand */
+int search(int start, int depth, int *off, int *adj,
+           int *order, int *level) {
+
+  int head=0, tail=0;
+  int i, u, v;
+
+  order[tail++] = start;
+  level[start] = 0;
+
+  while (head < tail) {
+    u = order[head++];
+    if ((depth >= 0) && (level[u] >= depth)) continue;
+    for (i=off[u]; i<off[u+1]; i++) {
+      v = adj[i];
+      if (level[v] != -1) continue;
+      level[v] = level[u] + 1;
+      order[tail++] = v;
+    }
+  }
+
+  return tail;
+}
+
+
+/* Function to write the descendants or ancestors of a person to stdout */
+int write_list(struct graph *g, int start, int depth, int *off, int *adj,
+               const char *label) {
+
+  int *order, *level;
+  int i, cnt;
+
+  order = malloc(sizeof(int)*g->nnode);
+  level = malloc(sizeof(int)*g->nnode);
+  if ((order == NULL) || (level == NULL)) return -1;
+  for (i=0; i<g->nnode; i++) level[i] = -1;
+
+  cnt = search(start, depth, off, adj, order, level);
+
+  fprintf(stdout, "%s of %s: %d\n", label, g->node[start].name, cnt-1);
+  for (i=1; i<cnt; i++) {
+    fprintf(stdout, "  %d  %s\n", level[order[i]], g->node[order[i]].name);
+  }
+
+  free(order);
+  free(level);
+
+  return(0);
+}
+
+
+/* Function to sort people by lineage size and then by name (for use with qsort) */
+struct graph *sort_graph;
+
+int compare_lineage(const void *s1, const void *s2) {
+  const struct person *p1 = &sort_graph->node[*(const int *)s1];
+  const struct person *p2 = &sort_graph->node[*(const int *)s2];
+
+  if (p1->lineage != p2->lineage) return (p1->lineage > p2->lineage) ? -1 : +1;
+  return strcmp(p1->nm.key, p2->nm.key);
+}
+
+
+/* Function to sort people by number of students and then by last name
+ * (for use with qsort) */
+int compare_students(const void *s1, const void *s2) {
+  int i1 = *(const int *)s1, i2 = *(const int *)s2;
+  int n1 = sort_graph->out_off[i1+1] - sort_graph->out_off[i1];
+  int n2 = sort_graph->out_off[i2+1] - sort_graph->out_off[i2];
+
+  if (n1 != n2) return (n1 > n2) ? -1 : +1;
+  return strcmp(sort_graph->node[i1].nm.key, sort_graph->node[i2].nm.key);
+}
+
+
+/* Function to return an array of person indices sorted by lineage size */
+int *rank_lineages(struct graph *g) {
+
+  int *rank;
+  int i;
+
+  rank = malloc(sizeof(int)*(g->nnode+1));
+  if (rank == NULL) return NULL;
+  for (i=0; i<g->nnode; i++) rank[i] = i;
+
+  sort_graph = g;
+  qsort(rank, g->nnode, sizeof(int), compare_lineage);
+
+  return rank;
+}
+
+
+/* Function to write the largest lineages to stdout */
+int write_top(struct graph *g, int top) {
+
+  int *rank;
+  int i, p;
+
+  rank = rank_lineages(g);
+  if (rank == NULL) return -1;
+
+  for (i=0; (i < top) && (i < g->nnode); i++) {
+    p = rank[i];
+    if (g->node[p].lineage == 0) break;
+    fprintf(stdout, "%4d  %4d  %s\n", g->node[p].lineage,
+            g->out_off[p+1] - g->out_off[p], g->node[p].name);
+  }
+
+  free(rank);
+
+  return(0);
+}
+
+
+/* Function to write each advisor with their number of students, and
+ * the degree and year of their own thesis if they were also a student,
+ * to stdout */
+int write_advisors(struct graph *g) {
+
+  int *rank;
+  int i, p, n, nadv=0, nstudent=0;
+
+  rank = malloc(sizeof(int)*(g->nnode+1));
+  if (rank == NULL) return -1;
+  for (i=0; i<g->nnode; i++) rank[i] = i;
+  sort_graph = g;
+  qsort(rank, g->nnode, sizeof(int), compare_students);
+
+  for (i=0; i<g->nnode; i++) {
+    p = rank[i];
+    n = g->out_off[p+1] - g->out_off[p];
+    if (n == 0) break;
+    fprintf(stdout, "%4d  %s, %s", n, g->node[p].nm.last, g->node[p].nm.initials);
+    if (g->node[p].year[0] != '\0') {
+      fprintf(stdout, "  (%s %s)", g->node[p].degree, g->node[p].year);
+      nstudent++;
+    }
+    fprintf(stdout, "\n");
+    nadv++;
+  }
+  fprintf(stdout, "%d advisors, %d of them also students\n", nadv, nstudent);
+
+  free(rank);
+
+  return(0);
+}
+
+
+/* Function to write the advisor -> student graph in DOT format to stdout */
+int write_dot(struct graph *g) {
+
+  int i;
+
+  fprintf(stdout, "digraph lineage {\n");
+  fprintf(stdout, "  rankdir=LR;\n");
+  for (i=0; i<g->nnode; i++) {
+    fprintf(stdout, "  n%d [label=", i);
+    write_quoted(stdout, g->node[i].name);
+    fprintf(stdout, "];\n");
+  }
+  for (i=0; i<g->nedge; i++) {
+    fprintf(stdout, "  n%d -> n%d;\n", g->edge[i][0], g->edge[i][1]);
+  }
+  fprintf(stdout, "}\n");
+
+  return(0);
+}
+
+
+/* Function to write a string as a quoted DOT string, with the " and \
+ * characters escaped by a backslash */
+void write_quoted(FILE *fp, const char *str) {
+
+  size_t n;
+
+  fputc('"', fp);
+  while (*str != '\0') {
+    n = strcspn(str, "\"\\");
+    if (n > 0) fwrite(str, 1, n, fp);
+    str += n;
+    if (*str == '\0') break;
+    fputc('\\', fp);
+    fputc(*str++, fp);
+  }
+  fputc('"', fp);
+}
+
+
+/* Function to write a string with the html special characters & < > " '
+ * replaced by entities. Runs of ordinary characters are found with
+ * strcspn, which the C library vectorizes, and written in one call */
+void write_escaped(FILE *fp, const char *str) {
+
+  size_t n;
+
+  while (*str != '\0') {
+    n = strcspn(str, "&<>\"'");
+    if (n > 0) fwrite_unlocked(str, 1, n, fp);
+    str += n;
+
+    switch (*str) {
+      case '&':  PUT_LIT(fp, "&amp;"); break;
+      case '<':  PUT_LIT(fp, "&lt;"); break;
+      case '>':  PUT_LIT(fp, "&gt;"); break;
+      case '"':  PUT_LIT(fp, "&quot;"); break;
+      case '\'': PUT_LIT(fp, "&#39;"); break;
+      default:   return;
+    }
+    str++;
+  }
+}
+
+
+/* Function to write the advisor -> student graph in GraphML format to stdout */
+int write_graphml(struct graph *g) {
+
+  int i;
+
+  fprintf(stdout, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+  fprintf(stdout, "<graphml xmlns=\"http://graphml.graphdrawing.org/xmlns\">\n");
+  fprintf(stdout, "  <key id=\"name\" for=\"node\" attr.name=\"name\" attr.type=\"string\"/>\n");
+  fprintf(stdout, "  <key id=\"lineage\" for=\"node\" attr.name=\"lineage\" attr.type=\"int\"/>\n");
+  fprintf(stdout, "  <graph id=\"lineage\" edgedefault=\"directed\">\n");
+  for (i=0; i<g->nnode; i++) {
+    fprintf(stdout, "    <node id=\"n%d\"><data key=\"name\">", i);
+    write_escaped(stdout, g->node[i].name);
+    fprintf(stdout, "</data><data key=\"lineage\">%d</data></node>\n", g->node[i].lineage);
+  }
+  for (i=0; i<g->nedge; i++) {
+    fprintf(stdout, "    <edge source=\"n%d\" target=\"n%d\"/>\n", g->edge[i][0], g->edge[i][1]);
+  }
+  fprintf(stdout, "  </graph>\n");
+  fprintf(stdout, "</graphml>\n");
+
+  return(0);
+}
+
+
+/* Function to write the students of a person as a nested html list,
+ * skipping anyone already on the current path in case of cycles, and
+ * marking everyone written as seen */
+void write_tree(struct graph *g, int p, int *onpath, int *seen, int indent) {
+
+  int i, s;
+
+  onpath[p] = 1;
+  seen[p] = 1;
+  fprintf(stdout, "%*s<ul>\n", indent, "");
+  for (i=g->out_off[p]; i<g->out_off[p+1]; i++) {
+    s = g->out_adj[i];
+    if (onpath[s]) continue;
+    fprintf(stdout, "%*s  <li>", indent, "");
+    write_escaped(stdout, g->node[s].name);
+    seen[s] = 1;
+    if (g->out_off[s+1] > g->out_off[s]) {
+      fprintf(stdout, "\n");
+      write_tree(g, s, onpath, seen, indent+4);
+      fprintf(stdout, "%*s  </li>\n", indent, "");
+    } else {
+      fprintf(stdout, "</li>\n");
+    }
+  }
+  fprintf(stdout, "%*s</ul>\n", indent, "");
+  onpath[p] = 0;
+}
+
+
+/* Function to build the lineage html and write it to stdout */
+int write_html(struct graph *g) {
+
+  int *rank, *onpath, *seen;
+  int i, p, pass, roots=0;
+
+  rank = rank_lineages(g);
+  onpath = calloc(g->nnode+1, sizeof(int));
+  seen = calloc(g->nnode+1, sizeof(int));
+  if ((rank == NULL) || (onpath == NULL) || (seen == NULL)) return -1;
+
+  /* Start writing html output to stdout */
+  fprintf(stdout, "<!-- *** BEGIN THESIS/DISSERTATION LINEAGE HERE *** --!>\n");
+  fprintf(stdout, "<div align=\"left\" style=\"width:600px; margin:auto;\">\n\n");
+
+  /* Step through each advisor with no known advisor of their own,
+   * starting with the largest lineage, then through any advisor not yet
+   * written, who can only be reached through a cycle of advisors with
+   * no root */
+  for (pass=0; pass<2; pass++) {
+    for (i=0; i<g->nnode; i++) {
+      p = rank[i];
+      if (g->node[p].lineage == 0) break;
+      if ((pass == 0) && (g->in_off[p+1] > g->in_off[p])) continue;
+      if ((pass == 1) && seen[p]) continue;
+
+      fprintf(stdout, "  <p><b>");
+      write_escaped(stdout, g->node[p].name);
+      fprintf(stdout, "</b> (%d)</p>\n", g->node[p].lineage);
+      write_tree(g, p, onpath, seen, 2);
+      fprintf(stdout, "\n");
+      roots++;
+    }
+  }
+
+  /* Print total number of people and links at bottom of page */
+  fprintf(stdout, "  <center>Number of lineages: <b>%d</b></center>\n", roots);
+  fprintf(stdout, "  <center>(%d people | %d advisor links)</center>\n\n",g->nnode,g->nedge);
+
+  /* Finish writing html output to stdout */
+  fprintf(stdout, "</div>\n");
+  fprintf(stdout, "<!-- *** END THESIS/DISSERTATION LINEAGE HERE *** --!>\n");
+
+  free(rank);
+  free(onpath);
+  free(seen);
+
+  return(0);
+}
@@ -0,0 +1,1906 @@
+/* parse_theses_site.c
+   ===================
+   Author: E.G.Thomas (2019)
+
+   This program parses a text file containing SuperDARN thesis
+   and dissertation information and writes a static website to a
+   directory tree instead of a single html page. The site contains
+   an index page, paginated alphabetical listing pages, one page per
+   institution, advisor, country and year, and a sitemap. Pages are
+   rendered in parallel by a pool of threads, and each page is built
+   in memory and written to its file in a single call. The program
+   can be compiled with:
+
+        gcc -o parse_theses_site parse_theses_site.c -lpthread -lz
+
+   and then executed using:
+
+        ./parse_theses_site superdarn_theses.txt
+
+   The following options are also available:
+
+        --output DIR      write the site to DIR (default: site)
+        --page-size N     number of entries on each listing page
+                          (default: 50)
+        --threads N       number of rendering threads (default: number
+                          of online processors)
+        --base-url URL    prefix for page locations in sitemap.xml
+                          (default: relative locations)
+        --gzip            also write a gzip-compressed copy of every
+                          page (eg, index.html.gz) for web servers that
+                          serve pre-compressed content. Pages are
+                          compressed on a separate thread as they are
+                          rendered
+        --io-uring        read the input and write the pages with
+                          queued io_uring requests, so that each page
+                          costs one open call instead of separate open,
+                          write and close calls (pages are still opened
+                          synchronously). Linux only; falls back to
+                          pread/pwrite if io_uring or its read, write or
+                          close operations are unavailable
+        --search-index    also write search.json, a prebuilt index for
+                          searching the site in the browser without a
+                          server (see write_index() for its format), and
+                          search.html and search.js, a search page that
+                          uses it, linked from the index page
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include <zlib.h>
+
+#define STRLEN 512
+
+/* Literal writers as in parse_theses.c, whose parsing, html and json
+ * writing and gzip queue functions below are kept the same (check.sh
+ * compares them) so that both programs render entries alike. Each page
+ * is rendered by one thread into its own stream, so no stream locking
+ * is needed */
+#define PUT_LIT(fp, s) fwrite_unlocked(s, 1, sizeof(s)-1, fp)
+#define CPY_LIT(p, s) (memcpy(p, s, sizeof(s)-1), (p) += sizeof(s)-1)
+
+/* Longest html table written for one entry: every field escaped to at
+ * most six times its length, plus the fixed fragments */
+#define ENTRYLEN (8*6*STRLEN)
+
+/* Length of the collation key of each entry, and of the part of it
+ * holding the folded author name */
+#define KEYLEN 64
+#define NAMEKEY 44
+
+/* Maximum number of lines kept for each entry */
+#define NSLOT 16
+
+/* Default number of entries on each listing page */
+#define PAGESIZE 50
+
+/* Maximum number of rendered pages waiting to be compressed */
+#define GZQUEUE 64
+
+/* Number of pages each thread keeps in flight with io_uring, and the
+ * size of each queued read of the input */
+#define URING_DEPTH 32
+#define BLOCKSIZE (256*1024)
+
+/* Known degree types */
+char *degrees[] = {"MS", "PhD"};
+#define NDEGREE (sizeof(degrees)/sizeof(degrees[0]))
+
+struct thesis {
+  char author[STRLEN];
+  char year[STRLEN];
+  char title[STRLEN];
+  char advisor[STRLEN];
+  char affiliation[STRLEN];
+  char degree[STRLEN];
+  char url[STRLEN];
+  unsigned char key[KEYLEN];
+  uint64_t id;
+};
+
+/* Finished pages waiting to be compressed */
+struct gzjob {
+  char path[2*STRLEN];
+  char *buf;
+  size_t size;
+};
+
+struct gzqueue {
+  struct gzjob job[GZQUEUE];
+  int head, count, done, errors;
+  pthread_mutex_t lock;
+  pthread_cond_t ready, space;
+  pthread_t thread;
+};
+
+/* Submission and completion rings shared with the kernel */
+struct uring {
+  int fd;
+  unsigned *sq_head, *sq_tail, *sq_mask, *sq_entries, *sq_array;
+  unsigned *cq_head, *cq_tail, *cq_mask;
+  struct io_uring_sqe *sqe;
+  struct io_uring_cqe *cqe;
+  void *sq_ring, *cq_ring;
+  size_t sq_size, cq_size, sqe_size;
+  unsigned queued;
+};
+
+/* Pages written by one thread with a write linked to a close */
+struct wslot {
+  int fd, pending, status;
+  char path[2*STRLEN];
+  char *buf;
+  size_t size;
+};
+
+struct writer {
+  struct site *s;
+  struct uring ring;
+  struct wslot slot[URING_DEPTH];
+  int busy;
+};
+
+/* Words of the search index with the entries containing each, in the
+ * order of the alphabetical listing */
+struct term {
+  char *word;
+  int *post;
+  int npost, maxpost;
+};
+
+struct index {
+  struct term *term;
+  int nterm, maxterm;
+  int *hash;
+  int hashsize;
+};
+
+/* Entries sharing an institution, advisor, country or year */
+struct group {
+  char name[STRLEN];
+  char slug[STRLEN];
+  int *idx;
+  int n;
+};
+
+struct facet {
+  char *dir;
+  char *label;
+  struct group *grp;
+  int ngrp;
+  int *idx;
+};
+
+enum { INSTITUTION, ADVISOR, COUNTRY, YEAR, NFACET };
+
+struct site {
+  struct thesis *entry;
+  int num;
+  int pagesize, npage;
+  struct facet facet[NFACET];
+  char *outdir;
+  char *baseurl;
+  struct gzqueue *gz;
+  int uring, search;
+
+  /* Next page to render and number of failed writes, shared by threads */
+  pthread_mutex_t lock;
+  int next, njob, errors;
+};
+
+
+struct thesis *parse_text(FILE *fp, int *num, int (*keep)(struct thesis *, void *), void *arg);
+int keep_entry(struct thesis *t, void *arg);
+int is_year(const char *line);
+void assign_fields(struct thesis *t, char **line, int n);
+int fold_char(const unsigned char **p, unsigned char *out);
+void make_key(struct thesis *t);
+void make_id(struct thesis *t);
+int compare(const void *s1, const void *s2);
+int build_facets(struct site *s);
+void *render_pages(void *arg);
+int render_page(struct site *s, int job, FILE *fp, char *path);
+int write_sitemap(struct site *s, FILE *fp, char *path);
+void *gz_thread(void *arg);
+int gz_start(struct gzqueue *q);
+void gz_push(struct gzqueue *q, const char *path, char *buf, size_t size);
+int gz_finish(struct gzqueue *q);
+void write_escaped(FILE *fp, const char *str);
+char *copy_escaped(char *dst, const char *str);
+char *copy_hex(char *dst, uint64_t v);
+int uring_init(struct uring *r, unsigned entries);
+struct io_uring_sqe *uring_get(struct uring *r);
+int uring_submit(struct uring *r, unsigned wait);
+int uring_reap(struct uring *r, unsigned long long *data, int *res);
+int uring_probe(struct uring *r, int op);
+void uring_exit(struct uring *r);
+char *read_input(const char *fname, size_t *size, int uring);
+int next_token(const char **str, char *tok);
+int add_posting(struct index *ix, const char *word, int entry);
+int compare_term(const void *s1, const void *s2);
+int write_index(struct site *s);
+int write_search(struct site *s);
+void write_json(FILE *fp, const char *str);
+int write_file(const char *path, const char *buf, size_t size);
+int queue_page(struct writer *w, const char *path, char *buf, size_t size);
+void reap_pages(struct writer *w, unsigned wait);
+void finish_page(struct writer *w, struct wslot *slot);
+
+
+int main(int argc, char *argv[]) {
+
+  char fname[STRLEN];
+  FILE *fp;
+  char *text;
+  size_t size;
+
+  struct site s;
+  struct gzqueue gz;
+  pthread_t *thread;
+  int i, nthread;
+  char *dir[NFACET+2] = {"", "list", "institution", "advisor", "country", "year"};
+  char path[2*STRLEN];
+
+  strcpy(fname, "superdarn_theses.txt");
+  memset(&s, 0, sizeof(s));
+  s.outdir = "site";
+  s.baseurl = "";
+  s.pagesize = PAGESIZE;
+  nthread = sysconf(_SC_NPROCESSORS_ONLN);
+
+  /* Get command line options and input filename */
+  for (i=1; i<argc; i++) {
+    if ((strcmp(argv[i], "--output") == 0) && (i+1 < argc)) s.outdir = argv[++i];
+    else if ((strcmp(argv[i], "--page-size") == 0) && (i+1 < argc)) s.pagesize = atoi(argv[++i]);
+    else if ((strcmp(argv[i], "--threads") == 0) && (i+1 < argc)) nthread = atoi(argv[++i]);
+    else if ((strcmp(argv[i], "--base-url") == 0) && (i+1 < argc)) s.baseurl = argv[++i];
+    else if (strcmp(argv[i], "--gzip") == 0) s.gz = &gz;
+    else if (strcmp(argv[i], "--io-uring") == 0) s.uring = 1;
+    else if (strcmp(argv[i], "--search-index") == 0) s.search = 1;
+    else if (strncmp(argv[i], "--", 2) == 0) {
+      fprintf(stderr, "Unknown option: %s\n", argv[i]);
+      return (-1);
+    } else strcpy(fname, argv[i]);
+  }
+  if (s.pagesize < 1) s.pagesize = PAGESIZE;
+  if (nthread < 1) nthread = 1;
+
+  /* Read input text file into memory with large queued reads */
+  text = read_input(fname, &size, s.uring);
+  if (text == NULL) {
+    fprintf(stderr, "Failed to read input file: %s\n", fname);
+    return (-1);
+  }
+
+  /* Parse input text file for information about each thesis/dissertation */
+  fp = fmemopen(text, size, "r");
+  if (fp == NULL) s.num = 0;
+  else s.entry = parse_text(fp, &s.num, keep_entry, NULL);
+
+  /* Close input text file */
+  if (fp != NULL) fclose(fp);
+  free(text);
+
+  /* Check for error when parsing input text file */
+  if (s.num == -1) {
+    fprintf(stderr, "Failed to parse input text file.\n");
+    return (-1);
+  }
+
+  /* Sort theses/dissertations first alphabetically by author last name and then by year */
+  qsort(s.entry, s.num, sizeof(struct thesis), compare);
+
+  /* Group entries by institution, advisor, country and year */
+  if (build_facets(&s) == -1) {
+    fprintf(stderr, "Failed to group entries.\n");
+    return (-1);
+  }
+
+  /* Create output directory tree */
+  for (i=0; i<NFACET+2; i++) {
+    sprintf(path, "%s/%s", s.outdir, dir[i]);
+    if ((mkdir(path, 0755) != 0) && (errno != EEXIST)) {
+      fprintf(stderr, "Failed to create directory: %s\n", path);
+      return (-1);
+    }
+  }
+
+  /* Pages are numbered with the index first, then the listing pages,
+   * then the group pages of each facet in turn, and the sitemap last */
+  s.npage = (s.num + s.pagesize - 1) / s.pagesize;
+  if (s.npage == 0) s.npage = 1;
+  s.njob = 1 + s.npage + 1;
+  for (i=0; i<NFACET; i++) s.njob += s.facet[i].ngrp;
+  if (nthread > s.njob) nthread = s.njob;
+
+  /* Start compressing pages as soon as they are rendered */
+  if ((s.gz != NULL) && (gz_start(s.gz) == -1)) {
+    fprintf(stderr, "Failed to start compression thread.\n");
+    return (-1);
+  }
+
+  /* Write the search index and page while the pages are compressed */
+  if (s.search && ((write_index(&s) == -1) || (write_search(&s) == -1))) {
+    fprintf(stderr, "Failed to write search index.\n");
+    s.errors++;
+  }
+
+  /* Render pages on a pool of threads */
+  pthread_mutex_init(&s.lock, NULL);
+  thread = malloc(sizeof(pthread_t)*nthread);
+  if (thread == NULL) {
+    fprintf(stderr, "Failed to allocate memory for threads.\n");
+    return (-1);
+  }
+  for (i=0; i<nthread; i++) {
+    if (pthread_create(&thread[i], NULL, render_pages, &s) != 0) break;
+  }
+  if (i == 0) render_pages(&s);
+  nthread = i;
+  for (i=0; i<nthread; i++) pthread_join(thread[i], NULL);
+  free(thread);
+  pthread_mutex_destroy(&s.lock);
+
+  /* Wait for the last pages to be compressed */
+  if (s.gz != NULL) s.errors += gz_finish(s.gz);
+
+  if (s.errors > 0) {
+    fprintf(stderr, "Failed to write %d pages.\n", s.errors);
+    return (-1);
+  }
+
+  fprintf(stderr, "Wrote %d pages to %s\n", s.njob-1, s.outdir);
+
+  return (0);
+}
+
+
+/* Function to parse a text file and store information about each
+ * thesis/dissertation in the appropriate field of a structure and
+ * return the number of entries found. An author line followed by a
+ * year line starts a new entry, so a missing or extra line only
+ * affects the entry it occurs in rather than every later entry. Each
+ * entry is passed to keep, if given, which returns 0 to drop it */
+struct thesis *parse_text(FILE *fp, int *num, int (*keep)(struct thesis *, void *), void *arg) {
+
+  struct thesis *entry=NULL, *grow;
+  char buf[NSLOT][STRLEN];
+  char *line[NSLOT], *tmp;
+  int i, c, n=0, cnt=0, max=0;
+  size_t len;
+
+  for (i=0; i<NSLOT; i++) line[i] = buf[i];
+
+  /* Read in each line of text file */
+  while (fgets(line[n], STRLEN, fp) != NULL) {
+
+    /* Trim \n at end of each line returned by fgets, discarding the rest
+     * of any line too long for a field rather than reading it as the next */
+    len = strcspn(line[n], "\r\n");
+    if ((line[n][len] == '\0') && (len == STRLEN-1)) {
+      while (((c = fgetc(fp)) != EOF) && (c != '\n'));
+    }
+    line[n][len] = 0;
+
+    /* Skip blank lines before the first field of an entry */
+    if ((n == 0) && (len == 0)) continue;
+
+    /* Store the previous entry when the next author and year are found */
+    if ((n >= 3) && (line[n-1][0] != '\0') && is_year(line[n])) {
+      if (cnt == max) {
+        max = (max == 0) ? 256 : 2*max;
+        grow = realloc(entry, sizeof(struct thesis)*max);
+        if (grow == NULL) {
+          free(entry);
+          *num = -1;
+          return NULL;
+        }
+        entry = grow;
+      }
+      assign_fields(&entry[cnt], line, n-1);
+      if ((keep == NULL) || keep(&entry[cnt], arg)) cnt++;
+
+      tmp = line[0]; line[0] = line[n-1]; line[n-1] = tmp;
+      tmp = line[1]; line[1] = line[n]; line[n] = tmp;
+      n = 2;
+      continue;
+    }
+
+    /* Advance to next line of entry. If an entry has far more lines than
+     * fields the second line of its title is dropped, keeping the fields
+     * after the title and the last lines read, which find the next
+     * author and year */
+    if (n < NSLOT-1) n++;
+    else {
+      tmp = line[3];
+      for (i=3; i<n; i++) line[i] = line[i+1];
+      line[n] = tmp;
+    }
+  }
+
+  /* Store the final entry */
+  if (n > 0) {
+    if (cnt == max) {
+      grow = realloc(entry, sizeof(struct thesis)*(max+1));
+      if (grow == NULL) {
+        free(entry);
+        *num = -1;
+        return NULL;
+      }
+      entry = grow;
+    }
+    assign_fields(&entry[cnt], line, n);
+    if ((keep == NULL) || keep(&entry[cnt], arg)) cnt++;
+  }
+
+  /* Return the number of thesis/dissertation entries read from file */
+  *num = cnt;
+
+  return entry;
+}
+
+
+/* Function to give a parsed entry its sort key and id, keeping every
+ * entry */
+int keep_entry(struct thesis *t, void *arg) {
+
+  (void)arg;
+  make_key(t);
+  make_id(t);
+
+  return 1;
+}
+
+
+/* Function to fold the character at *p to lowercase ASCII without
+ * diacritics, storing it in out and returning the number of bytes
+ * stored (0 for punctuation), and leaving *p at its last byte. Other
+ * UTF-8 characters are kept byte by byte, after all ASCII letters */
+int fold_char(const unsigned char **p, unsigned char *out) {
+
+  const char *latin1 = "aaaaaaaceeeeiiiidnooooo\0ouuuuyts"
+                       "aaaaaaaceeeeiiiidnooooo\0ouuuuyty";
+  const char *latinA = "aaaaaaccccccccddddeeeeeeeeeegggggggghhhhiiiiiiiiiiiijjkkk"
+                       "llllllllllnnnnnnnnnoooooooorrrrrrssssssssttttttuuuuuuuuuuuu"
+                       "wwyyyzzzzzzs";
+  const unsigned char *c = *p;
+
+  if (isalnum(c[0])) {
+    out[0] = tolower(c[0]);
+    return 1;
+  }
+
+  /* Two-byte sequences C3 80 to C3 BF cover À to ÿ, and C4 80 to C5 BF
+   * cover Ā to ſ */
+  if ((c[0] == 0xC3) && (c[1] >= 0x80) && (c[1] <= 0xBF)) {
+    (*p)++;
+    out[0] = latin1[c[1] - 0x80];
+    return (out[0] != 0);
+  }
+  if (((c[0] == 0xC4) || (c[0] == 0xC5)) && (c[1] >= 0x80) && (c[1] <= 0xBF)) {
+    (*p)++;
+    out[0] = latinA[((c[0] - 0xC4) << 6) | (c[1] - 0x80)];
+    return 1;
+  }
+
+  if (c[0] >= 0x80) {
+    out[0] = c[0];
+    return 1;
+  }
+
+  return 0;
+}
+
+
+/* Function to build the collation key of an entry once, so that sorting
+ * only needs memcmp(). The key holds the author's last name and then
+ * first names with case and diacritics folded, ignoring spaces and
+ * punctuation so that name particles sort the same however they are
+ * written (eg, "de Larquier" and "DeLarquier"), and with "St." and
+ * "Ste." spelled out. It is padded to NAMEKEY bytes and followed by
+ * the year and then the raw author, which only break ties */
+void make_key(struct thesis *t) {
+
+  unsigned char *key = t->key;
+  const unsigned char *p = (const unsigned char *)t->author;
+  int n=0, word=1, comma=0;
+
+  memset(key, 0, KEYLEN);
+  for (; (*p != '\0') && (n < NAMEKEY); p++) {
+
+    /* Separate the last name from the first names with a byte that
+     * sorts before any letter */
+    if ((*p == ',') && !comma) {
+      key[n++] = 1;
+      comma = word = 1;
+      continue;
+    }
+
+    if (word && (tolower(p[0]) == 's') && (p[1] == 't') &&
+        ((p[2] == '.') || (p[2] == ' ') || ((p[2] == 'e') && (p[3] == '.')))) {
+      strncpy((char *)key+n, (p[2] == 'e') ? "sainte" : "saint", NAMEKEY-n);
+      n += (p[2] == 'e') ? 6 : 5;
+      p += (p[2] == 'e') ? 2 : 1;
+      if (n > NAMEKEY) n = NAMEKEY;
+      continue;
+    }
+
+    word = (isspace(*p) || (*p == '.') || (*p == '-') || (*p == '\''));
+    n += fold_char(&p, key+n);
+  }
+
+  memcpy(key+NAMEKEY, t->year, strnlen(t->year, 4));
+  memcpy(key+NAMEKEY+4, t->author, strnlen(t->author, KEYLEN-NAMEKEY-4));
+}
+
+
+/* Function to compute the ID of an entry once, as a 64-bit FNV-1a hash
+ * of its author, year and title with case, diacritics, spaces and
+ * punctuation folded away, so that it is kept through small changes in
+ * how they are written. Characters fold_char() cannot fold to ASCII
+ * (eg, Greek, Cyrillic or CJK text, or signs such as ×) are hashed as
+ * their UTF-8 bytes, so that they still tell entries apart. It names
+ * the anchor of the entry in the html and identifies the entry across
+ * catalogues and edits */
+void make_id(struct thesis *t) {
+
+  const char *field[3];
+  const unsigned char *p, *q;
+  unsigned char c;
+  uint64_t h = 14695981039346656037ULL;
+  int i;
+
+  field[0] = t->author;
+  field[1] = t->year;
+  field[2] = t->title;
+  for (i=0; i<3; i++) {
+    for (p=(const unsigned char *)field[i]; *p != '\0'; p++) {
+      q = p;
+      if (fold_char(&p, &c) && (c < 0x80)) h = (h ^ c) * 1099511628211ULL;
+      else if (*q >= 0x80) {
+        h = (h ^ *q++) * 1099511628211ULL;
+        while ((*q & 0xC0) == 0x80) h = (h ^ *q++) * 1099511628211ULL;
+        p = q-1;
+      }
+    }
+    h = (h ^ '\n') * 1099511628211ULL;
+  }
+
+  t->id = h;
+}
+
+
+/* Function to check whether a line holds a four-digit year */
+int is_year(const char *line) {
+  return isdigit((unsigned char)line[0]) && isdigit((unsigned char)line[1]) &&
+         isdigit((unsigned char)line[2]) && isdigit((unsigned char)line[3]) &&
+         (line[4] == '\0');
+}
+
+
+/* Function to assign the n lines of an entry to the fields of a structure.
+ * Well-formed entries have seven lines (eight with the blank separator),
+ * while shorter or longer entries are assigned by rule: a trailing line
+ * starting with "http" is the URL, a known degree type is the degree,
+ * extra lines after the title are joined to it (eg, a wrapped title), and
+ * a lone line between the title and degree is taken to be the affiliation
+ * if it contains a comma but no "&" and the advisor otherwise */
+void assign_fields(struct thesis *t, char **line, int n) {
+
+  int i, m;
+  char **f;
+
+  /* Strip trailing blank lines, which are separators or empty fields */
+  while ((n > 2) && (line[n-1][0] == '\0')) n--;
+
+  strcpy(t->author, line[0]);
+  strcpy(t->year, (n > 1) ? line[1] : "");
+  t->title[0] = t->advisor[0] = t->affiliation[0] = t->degree[0] = t->url[0] = 0;
+
+  f = line+2;
+  m = n-2;
+  if (m <= 0) return;
+
+  if ((strncmp(f[m-1], "http", 4) == 0) || (m == 5)) strcpy(t->url, f[--m]);
+  if (m == 0) return;
+
+  for (i=0; i<(int)NDEGREE; i++) if (strcmp(f[m-1], degrees[i]) == 0) break;
+  if ((i < (int)NDEGREE) || (m == 4)) strcpy(t->degree, f[--m]);
+
+  strcpy(t->title, f[0]);
+  if (m > 3) {
+    for (i=1; i<m-2; i++) {
+      strncat(t->title, " ", STRLEN-strlen(t->title)-1);
+      strncat(t->title, f[i], STRLEN-strlen(t->title)-1);
+    }
+    strcpy(t->advisor, f[m-2]);
+    strcpy(t->affiliation, f[m-1]);
+  } else if (m == 3) {
+    strcpy(t->advisor, f[1]);
+    strcpy(t->affiliation, f[2]);
+  } else if (m == 2) {
+    if ((strchr(f[1], ',') != NULL) && (strchr(f[1], '&') == NULL)) strcpy(t->affiliation, f[1]);
+    else strcpy(t->advisor, f[1]);
+  }
+}
+
+
+/* Function to sort theses/dissertations first by author last name
+ * and then by year (for use with qsort) */
+int compare(const void *s1, const void *s2) {
+  struct thesis *t1 = (struct thesis *)s1;
+  struct thesis *t2 = (struct thesis *)s2;
+
+  return memcmp(t1->key, t2->key, KEYLEN);
+}
+
+
+/* Function to write a string with the html special characters & < > " '
+ * replaced by entities. Runs of ordinary characters are found with
+ * strcspn, which the C library vectorizes, and written in one call */
+void write_escaped(FILE *fp, const char *str) {
+
+  size_t n;
+
+  while (*str != '\0') {
+    n = strcspn(str, "&<>\"'");
+    if (n > 0) fwrite_unlocked(str, 1, n, fp);
+    str += n;
+
+    switch (*str) {
+      case '&':  PUT_LIT(fp, "&amp;"); break;
+      case '<':  PUT_LIT(fp, "&lt;"); break;
+      case '>':  PUT_LIT(fp, "&gt;"); break;
+      case '"':  PUT_LIT(fp, "&quot;"); break;
+      case '\'': PUT_LIT(fp, "&#39;"); break;
+      default:   return;
+    }
+    str++;
+  }
+}
+
+
+/* Function to build a file name from a group name, keeping only
+ * lowercase ASCII letters and digits separated by single dashes
+ * (bytes of non-ASCII characters are dropped) */
+void make_slug(const char *name, char *slug) {
+
+  int n=0;
+
+  for (; (*name != 0) && (n < STRLEN-16); name++) {
+    if ((unsigned char)*name >= 0x80) continue;
+    if (isalnum((unsigned char)*name)) slug[n++] = tolower((unsigned char)*name);
+    else if ((n > 0) && (slug[n-1] != '-')) slug[n++] = '-';
+  }
+  if ((n > 0) && (slug[n-1] == '-')) n--;
+  if (n == 0) slug[n++] = 'x';
+  slug[n] = 0;
+}
+
+
+/* Facet items pair a group name with an entry index */
+struct item {
+  char name[STRLEN];
+  int entry;
+};
+
+
+/* Function to sort facet items by name and then by entry (for use with qsort) */
+int compare_item(const void *s1, const void *s2) {
+  const struct item *i1 = (const struct item *)s1;
+  const struct item *i2 = (const struct item *)s2;
+  int namecompare = strcmp(i1->name, i2->name);
+
+  if (namecompare != 0) return namecompare;
+  return i1->entry - i2->entry;
+}
+
+
+/* Function to add a trimmed group name for an entry to a list of items */
+int add_item(struct item **item, int *n, int *max, const char *name, int len, int entry) {
+
+  while ((len > 0) && isspace((unsigned char)*name)) {
+    name++;
+    len--;
+  }
+  while ((len > 0) && isspace((unsigned char)name[len-1])) len--;
+  if (len <= 0) return 0;
+  if (len >= STRLEN) len = STRLEN-1;
+
+  if (*n == *max) {
+    *max = (*max == 0) ? 1024 : 2*(*max);
+    *item = realloc(*item, sizeof(struct item)*(*max));
+    if (*item == NULL) return -1;
+  }
+  memcpy((*item)[*n].name, name, len);
+  (*item)[*n].name[len] = 0;
+  (*item)[*n].entry = entry;
+  (*n)++;
+
+  return 0;
+}
+
+
+/* Function to collect the items of one facet from every entry. Advisors
+ * are separated by "," or "&", and affiliations are written as
+ * "Institution, Country" with several joined by "&", where an
+ * institution without a country takes the country that follows it */
+int collect_items(struct site *s, int f, struct item **item, int *n) {
+
+  char *str, *end, *comma, *country;
+  int i, max=0, len, clen;
+
+  *item = NULL;
+  *n = 0;
+
+  for (i=0; i<s->num; i++) {
+    switch (f) {
+      case ADVISOR:
+        for (str=s->entry[i].advisor; *str != 0; str=end+(*end != 0)) {
+          end = str + strcspn(str, ",&");
+          if (add_item(item, n, &max, str, end-str, i) == -1) return -1;
+        }
+        break;
+      case INSTITUTION:
+      case COUNTRY:
+        str = s->entry[i].affiliation;
+        country = NULL;
+        clen = 0;
+        for (end=str+strlen(str); end > str; end=str+len) {
+          /* Work backwards through the "&"-separated affiliations */
+          for (len=end-str; (len > 0) && (str[len-1] != '&'); len--);
+          comma = NULL;
+          for (char *p=str+len; p<end; p++) if (*p == ',') comma = p;
+          if (comma != NULL) {
+            country = comma+1;
+            clen = end-country;
+          }
+          if (f == INSTITUTION) {
+            if (add_item(item, n, &max, str+len, ((comma != NULL) ? comma : end)-(str+len), i) == -1) return -1;
+          } else if ((country != NULL) && ((comma != NULL) || (len == 0))) {
+            if (add_item(item, n, &max, country, clen, i) == -1) return -1;
+          }
+          if (len > 0) len--;
+        }
+        break;
+      case YEAR:
+        if (add_item(item, n, &max, s->entry[i].year, strlen(s->entry[i].year), i) == -1) return -1;
+        break;
+    }
+  }
+
+  return 0;
+}
+
+
+/* Function to group the entries of each facet by name */
+int build_facets(struct site *s) {
+
+  char *dir[NFACET] = {"institution", "advisor", "country", "year"};
+  char *label[NFACET] = {"Institution", "Advisor", "Country", "Year"};
+  struct facet *f;
+  struct item *item;
+  struct group tmp;
+  unsigned int h;
+  const char *p;
+  char *slug;
+  int i, j, k, n, m, g, len, dup, *hash, hashsize;
+
+  for (k=0; k<NFACET; k++) {
+    f = &s->facet[k];
+    f->dir = dir[k];
+    f->label = label[k];
+
+    if (collect_items(s, k, &item, &n) == -1) return -1;
+    qsort(item, n, sizeof(struct item), compare_item);
+
+    /* Drop repeated entries within a group (eg, two campuses of the
+     * same institution in one affiliation) */
+    for (i=0, m=0; i<n; i++) {
+      if ((m > 0) && (compare_item(&item[i], &item[m-1]) == 0)) continue;
+      item[m++] = item[i];
+    }
+    n = m;
+
+    f->idx = malloc(sizeof(int)*(n+1));
+    f->grp = malloc(sizeof(struct group)*(n+1));
+    if ((f->idx == NULL) || (f->grp == NULL)) return -1;
+    f->ngrp = 0;
+
+    /* Open-addressed table of the slugs in use, at most half full */
+    for (hashsize=16; hashsize < 2*(n+1); hashsize*=2);
+    hash = malloc(sizeof(int)*hashsize);
+    if (hash == NULL) return -1;
+    for (m=0; m<hashsize; m++) hash[m] = -1;
+
+    for (i=0; i<n; i=j) {
+      g = f->ngrp++;
+      strcpy(f->grp[g].name, item[i].name);
+      f->grp[g].idx = &f->idx[i];
+      for (j=i; (j<n) && (strcmp(item[j].name, item[i].name) == 0); j++) f->idx[j] = item[j].entry;
+      f->grp[g].n = j-i;
+
+      /* Make file names unique if group names fold to the same slug,
+       * numbering the later ones until the slug is not in use */
+      slug = f->grp[g].slug;
+      make_slug(item[i].name, slug);
+      len = strlen(slug);
+      for (dup=1; ; dup++) {
+        if (dup > 1) sprintf(slug+len, "-%d", dup);
+        h = 2166136261u;
+        for (p=slug; *p != 0; p++) h = (h ^ (unsigned char)*p) * 16777619u;
+        for (m=h & (hashsize-1); hash[m] != -1; m=(m+1) & (hashsize-1)) {
+          if (strcmp(f->grp[hash[m]].slug, slug) == 0) break;
+        }
+        if (hash[m] == -1) break;
+      }
+      hash[m] = g;
+    }
+    free(item);
+    free(hash);
+
+    /* List years from most recent */
+    if (k == YEAR) {
+      for (i=0, j=f->ngrp-1; i<j; i++, j--) {
+        tmp = f->grp[i];
+        f->grp[i] = f->grp[j];
+        f->grp[j] = tmp;
+      }
+    }
+  }
+
+  return 0;
+}
+
+
+/* Function to take pages from the shared counter and render them until
+ * none are left (run by each thread in the pool). Each page is written
+ * with a single call, or queued on the thread's io_uring if requested */
+void *render_pages(void *arg) {
+
+  struct site *s = (struct site *)arg;
+  struct writer *w;
+  char path[2*STRLEN];
+  char *buf;
+  size_t size;
+  FILE *mem;
+  int job, status, uring;
+
+  w = malloc(sizeof(struct writer));
+  if (w == NULL) {
+    fprintf(stderr, "Failed to allocate memory for page writer.\n");
+    pthread_mutex_lock(&s->lock);
+    s->errors++;
+    pthread_mutex_unlock(&s->lock);
+    return NULL;
+  }
+  w->s = s;
+  w->busy = 0;
+  uring = s->uring && (uring_init(&w->ring, 2*URING_DEPTH) == 0);
+  if (uring && !(uring_probe(&w->ring, IORING_OP_WRITE) &&
+                 uring_probe(&w->ring, IORING_OP_CLOSE))) {
+    uring_exit(&w->ring);
+    uring = 0;
+  }
+
+  for (;;) {
+    pthread_mutex_lock(&s->lock);
+    job = s->next++;
+    pthread_mutex_unlock(&s->lock);
+    if (job >= s->njob) break;
+
+    /* Build page in memory */
+    buf = NULL;
+    size = 0;
+    mem = open_memstream(&buf, &size);
+    status = (mem == NULL) ? -1 : render_page(s, job, mem, path);
+    if (mem != NULL) fclose(mem);
+
+    if ((status == 0) && uring) {
+      if (queue_page(w, path, buf, size) == 0) continue;
+      status = -1;
+    } else if (status == 0) status = write_file(path, buf, size);
+
+    /* Hand the page to the compression thread, which frees it */
+    if ((status == 0) && (s->gz != NULL)) gz_push(s->gz, path, buf, size);
+    else free(buf);
+
+    if (status != 0) {
+      pthread_mutex_lock(&s->lock);
+      s->errors++;
+      pthread_mutex_unlock(&s->lock);
+    }
+  }
+
+  /* Wait for the pages still being written */
+  if (uring) {
+    while (w->busy > 0) reap_pages(w, 1);
+    uring_exit(&w->ring);
+  }
+  free(w);
+
+  return NULL;
+}
+
+
+/* Function to write the start of a page, with links relative to its depth */
+void write_header(FILE *fp, const char *title, const char *root) {
+
+  fprintf(fp, "<!DOCTYPE html>\n");
+  fprintf(fp, "<html>\n<head>\n");
+  fprintf(fp, "  <meta charset=\"utf-8\">\n");
+  fprintf(fp, "  <title>SuperDARN Theses &amp; Dissertations: ");
+  write_escaped(fp, title);
+  fprintf(fp, "</title>\n");
+  fprintf(fp, "</head>\n<body>\n");
+  fprintf(fp, "<div align=\"center\">\n\n");
+  fprintf(fp, "  <a href=\"%sindex.html\">Index</a>&nbsp;|\n", root);
+  fprintf(fp, "  <a href=\"%slist/page-1.html\">All theses/dissertations</a>\n", root);
+  fprintf(fp, "  <h2>");
+  write_escaped(fp, title);
+  fprintf(fp, "</h2>\n\n");
+}
+
+
+/* Function to write the end of a page */
+void write_footer(FILE *fp, int *idx, int n, struct thesis *entry) {
+
+  int i, ms_cnt=0, phd_cnt=0;
+
+  /* Count number of theses/dissertations by degree type */
+  for (i=0; i<n; i++) {
+    if (strcmp(entry[idx[i]].degree, "MS") == 0) ms_cnt++;
+    else if (strcmp(entry[idx[i]].degree, "PhD") == 0) phd_cnt++;
+  }
+
+  fprintf(fp, "  <center>Number of items: <b>%d</b></center>\n", n);
+  fprintf(fp, "  <center>(%d MS | %d PhD)</center>\n\n",ms_cnt,phd_cnt);
+  fprintf(fp, "</div>\n");
+  fprintf(fp, "</body>\n</html>\n");
+}
+
+
+/* Function to copy a string into dst with the html special characters
+ * replaced by entities, returning the end of the copy */
+char *copy_escaped(char *dst, const char *str) {
+
+  size_t n;
+
+  while (*str != '\0') {
+    n = strcspn(str, "&<>\"'");
+    memcpy(dst, str, n);
+    dst += n;
+    str += n;
+
+    switch (*str) {
+      case '&':  CPY_LIT(dst, "&amp;"); break;
+      case '<':  CPY_LIT(dst, "&lt;"); break;
+      case '>':  CPY_LIT(dst, "&gt;"); break;
+      case '"':  CPY_LIT(dst, "&quot;"); break;
+      case '\'': CPY_LIT(dst, "&#39;"); break;
+      default:   return dst;
+    }
+    str++;
+  }
+  return dst;
+}
+
+
+/* Function to copy a 64-bit ID into dst as 16 hex digits, returning
+ * the end of the copy */
+char *copy_hex(char *dst, uint64_t v) {
+
+  int i;
+
+  for (i=15; i>=0; i--) {
+    dst[i] = "0123456789abcdef"[v & 15];
+    v >>= 4;
+  }
+  return dst+16;
+}
+
+
+/* Function to write the html table for one thesis/dissertation. The
+ * table is built in a local buffer from literals of known length and
+ * the escaped fields, then written with a single call */
+void write_entry(FILE *fp, struct thesis *entry) {
+
+  char buf[ENTRYLEN], *p = buf;
+
+  CPY_LIT(p, "  <a name=r");
+  p = copy_hex(p, entry->id);
+  CPY_LIT(p, "></a>\n  <table style=\"border:1px solid black; width:600px;\">\n"
+             "    <tr><td><b>Author:</b> ");
+  p = copy_escaped(p, entry->author);
+  CPY_LIT(p, "</td></tr>\n    <tr><td><b>Year:</b> ");
+  p = copy_escaped(p, entry->year);
+  CPY_LIT(p, "</td></tr>\n    <tr><td><b>Title:</b> ");
+  p = copy_escaped(p, entry->title);
+  CPY_LIT(p, "</td></tr>\n    <tr><td><b>Advisor:</b> ");
+  p = copy_escaped(p, entry->advisor);
+  CPY_LIT(p, "</td></tr>\n    <tr><td><b>Affiliation:</b> ");
+  p = copy_escaped(p, entry->affiliation);
+  CPY_LIT(p, "</td></tr>\n    <tr><td><b>Degree:</b> ");
+  p = copy_escaped(p, entry->degree);
+  if (entry->url[0] == '\0') {
+    CPY_LIT(p, "</td></tr>\n  </table><br>\n\n");
+  } else {
+    CPY_LIT(p, "</td><td align=\"right\"><a href=\"");
+    p = copy_escaped(p, entry->url);
+    CPY_LIT(p, "\" target=\"_blank\">URL</a></td></tr>\n  </table><br>\n\n");
+  }
+  fwrite_unlocked(buf, 1, p-buf, fp);
+}
+
+
+/* Function to write links to the first, previous, next and last pages */
+void write_pager(FILE *fp, int page, int npage) {
+
+  int i;
+
+  if (npage < 2) return;
+
+  fprintf(fp, "  <b>Page:</b>&nbsp;\n");
+  if (page > 1) fprintf(fp, "  <a href=\"page-%d.html\">&laquo; Prev</a>&nbsp;|\n", page-1);
+  for (i=1; i<=npage; i++) {
+    if (i == page) fprintf(fp, "  <b>%d</b>", i);
+    else fprintf(fp, "  <a href=\"page-%d.html\">%d</a>", i, i);
+    fprintf(fp, (i < npage) ? "&nbsp;|\n" : "\n");
+  }
+  if (page < npage) fprintf(fp, "  |&nbsp;<a href=\"page-%d.html\">Next &raquo;</a>\n", page+1);
+  fprintf(fp, "  <br><br>\n\n");
+}
+
+
+/* Function to render one page of the site to fp and return its path */
+int render_page(struct site *s, int job, FILE *fp, char *path) {
+
+  struct facet *f;
+  struct group *g;
+  int i, k, page, first, n;
+  int *idx;
+  char title[2*STRLEN];
+
+  /* Sitemap listing every page */
+  if (job == s->njob-1) return write_sitemap(s, fp, path);
+
+  /* Index page linking to every listing and group page */
+  if (job == 0) {
+    sprintf(path, "%s/index.html", s->outdir);
+    write_header(fp, "Index", "");
+
+    fprintf(fp, "  <p><a href=\"list/page-1.html\">All %d theses/dissertations</a></p>\n\n", s->num);
+    if (s->search) {
+      fprintf(fp, "  <form action=\"search.html\">\n");
+      fprintf(fp, "    <input name=\"q\" size=\"40\"> <input type=\"submit\" value=\"Search\">\n");
+      fprintf(fp, "  </form>\n\n");
+    }
+    for (k=0; k<NFACET; k++) {
+      f = &s->facet[k];
+      fprintf(fp, "  <h3>By %s</h3>\n", f->label);
+      fprintf(fp, "  <p>\n");
+      for (i=0; i<f->ngrp; i++) {
+        fprintf(fp, "    <a href=\"%s/%s.html\">", f->dir, f->grp[i].slug);
+        write_escaped(fp, f->grp[i].name);
+        fprintf(fp, "</a>&nbsp;(%d)%s\n", f->grp[i].n, (i < f->ngrp-1) ? "&nbsp;|" : "");
+      }
+      fprintf(fp, "  </p>\n\n");
+    }
+
+    fprintf(fp, "</div>\n");
+    fprintf(fp, "</body>\n</html>\n");
+    return 0;
+  }
+
+  /* Paginated alphabetical listing */
+  if (job <= s->npage) {
+    page = job;
+    first = (page-1)*s->pagesize;
+    n = s->num - first;
+    if (n > s->pagesize) n = s->pagesize;
+
+    sprintf(path, "%s/list/page-%d.html", s->outdir, page);
+    sprintf(title, "All theses/dissertations (page %d of %d)", page, s->npage);
+    write_header(fp, title, "../");
+    write_pager(fp, page, s->npage);
+
+    idx = malloc(sizeof(int)*(n+1));
+    if (idx == NULL) return -1;
+    for (i=0; i<n; i++) {
+      idx[i] = first+i;
+      write_entry(fp, &s->entry[first+i]);
+    }
+    write_pager(fp, page, s->npage);
+    write_footer(fp, idx, n, s->entry);
+    free(idx);
+    return 0;
+  }
+
+  /* Page for one institution, advisor, country or year */
+  job -= 1 + s->npage;
+  for (k=0; (k < NFACET) && (job >= s->facet[k].ngrp); k++) job -= s->facet[k].ngrp;
+  if (k == NFACET) return -1;
+  f = &s->facet[k];
+  g = &f->grp[job];
+
+  sprintf(path, "%s/%s/%s.html", s->outdir, f->dir, g->slug);
+  sprintf(title, "%s: %s", f->label, g->name);
+  write_header(fp, title, "../");
+  for (i=0; i<g->n; i++) write_entry(fp, &s->entry[g->idx[i]]);
+  write_footer(fp, g->idx, g->n, s->entry);
+
+  return 0;
+}
+
+
+/* Function to write a sitemap listing every page of the site to fp
+ * and return its path */
+int write_sitemap(struct site *s, FILE *fp, char *path) {
+
+  int i, k;
+
+  sprintf(path, "%s/sitemap.xml", s->outdir);
+
+  fprintf(fp, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+  fprintf(fp, "<urlset xmlns=\"http://www.sitemaps.org/schemas/sitemap/0.9\">\n");
+  fprintf(fp, "  <url><loc>");
+  write_escaped(fp, s->baseurl);
+  fprintf(fp, "index.html</loc></url>\n");
+  for (i=1; i<=s->npage; i++) {
+    fprintf(fp, "  <url><loc>");
+    write_escaped(fp, s->baseurl);
+    fprintf(fp, "list/page-%d.html</loc></url>\n", i);
+  }
+  for (k=0; k<NFACET; k++) {
+    for (i=0; i<s->facet[k].ngrp; i++) {
+      fprintf(fp, "  <url><loc>");
+      write_escaped(fp, s->baseurl);
+      fprintf(fp, "%s/%s.html</loc></url>\n", s->facet[k].dir, s->facet[k].grp[i].slug);
+    }
+  }
+  fprintf(fp, "</urlset>\n");
+
+  return 0;
+}
+
+
+/* Function to copy the next word of a string into tok, lowercased, and
+ * return its length, or 0 at the end of the string. Words are runs of
+ * letters and digits, with any UTF-8 characters kept as they are */
+int next_token(const char **str, char *tok) {
+
+  const unsigned char *p = (const unsigned char *)*str;
+  int n=0;
+
+  while ((*p != '\0') && !isalnum(*p) && (*p < 0x80)) p++;
+  while (((*p >= 0x80) || isalnum(*p)) && (n < STRLEN-1)) tok[n++] = tolower(*p++);
+  while ((*p >= 0x80) || isalnum(*p)) p++;
+  tok[n] = 0;
+  *str = (const char *)p;
+
+  return n;
+}
+
+
+/* Function to add an entry to the postings of a word, adding the word
+ * to the index if it has not been seen before */
+int add_posting(struct index *ix, const char *word, int entry) {
+
+  unsigned int h=2166136261u;
+  struct term *t;
+  const char *p;
+  int i, j;
+
+  /* FNV-1a hash of the word into an open-addressed table */
+  for (p=word; *p != 0; p++) h = (h ^ (unsigned char)*p) * 16777619u;
+  for (i=h & (ix->hashsize-1); ix->hash[i] != -1; i=(i+1) & (ix->hashsize-1)) {
+    if (strcmp(ix->term[ix->hash[i]].word, word) == 0) break;
+  }
+
+  if (ix->hash[i] == -1) {
+    if (ix->nterm == ix->maxterm) {
+      ix->maxterm *= 2;
+      t = realloc(ix->term, sizeof(struct term)*ix->maxterm);
+      if (t == NULL) return -1;
+      ix->term = t;
+    }
+    t = &ix->term[ix->nterm];
+    t->word = strdup(word);
+    t->post = malloc(sizeof(int)*4);
+    t->npost = 0;
+    t->maxpost = 4;
+    if ((t->word == NULL) || (t->post == NULL)) return -1;
+    ix->hash[i] = ix->nterm++;
+
+    /* Grow hash table to keep the load factor below one half */
+    if (2*ix->nterm > ix->hashsize) {
+      free(ix->hash);
+      ix->hashsize *= 2;
+      ix->hash = malloc(sizeof(int)*ix->hashsize);
+      if (ix->hash == NULL) return -1;
+      for (j=0; j<ix->hashsize; j++) ix->hash[j] = -1;
+      for (j=0; j<ix->nterm; j++) {
+        h = 2166136261u;
+        for (p=ix->term[j].word; *p != 0; p++) h = (h ^ (unsigned char)*p) * 16777619u;
+        for (i=h & (ix->hashsize-1); ix->hash[i] != -1; i=(i+1) & (ix->hashsize-1));
+        ix->hash[i] = j;
+      }
+    }
+    t = &ix->term[ix->nterm-1];
+  } else t = &ix->term[ix->hash[i]];
+
+  /* Entries are added in order, so a repeated word is the last posting */
+  if ((t->npost > 0) && (t->post[t->npost-1] == entry)) return 0;
+  if (t->npost == t->maxpost) {
+    t->maxpost *= 2;
+    t->post = realloc(t->post, sizeof(int)*t->maxpost);
+    if (t->post == NULL) return -1;
+  }
+  t->post[t->npost++] = entry;
+
+  return 0;
+}
+
+
+/* Function to compare two words of the search index */
+int compare_term(const void *s1, const void *s2) {
+
+  return strcmp(((const struct term *)s1)->word, ((const struct term *)s2)->word);
+}
+
+
+/* Function to write search.json, holding a record table with the
+ * author, year, title and listing page of each entry in alphabetical
+ * order, and the position in that table of every entry containing each
+ * word of its author, title, advisor or affiliation:
+ *
+ *   {"records": [["author", "year", "title", "list/page-1.html#r..."], ...],
+ *    "terms": {"word": [first, gap, gap, ...], ...}}
+ *
+ * Words are in sorted order for prefix searches, and each posting list
+ * is delta-encoded, holding the first position and then the gap to each
+ * following one, which keeps the numbers small */
+int write_index(struct site *s) {
+
+  struct index ix;
+  struct thesis *t;
+  const char *field[4], *p;
+  char tok[STRLEN], path[2*STRLEN];
+  char *buf=NULL;
+  size_t size=0;
+  FILE *fp;
+  int i, j, k, status=0;
+
+  ix.nterm = 0;
+  ix.maxterm = 1024;
+  ix.hashsize = 2048;
+  ix.term = malloc(sizeof(struct term)*ix.maxterm);
+  ix.hash = malloc(sizeof(int)*ix.hashsize);
+  if ((ix.term == NULL) || (ix.hash == NULL)) return -1;
+  for (i=0; i<ix.hashsize; i++) ix.hash[i] = -1;
+
+  /* Collect the postings of every word */
+  for (i=0; (i < s->num) && (status == 0); i++) {
+    t = &s->entry[i];
+    field[0] = t->author;
+    field[1] = t->title;
+    field[2] = t->advisor;
+    field[3] = t->affiliation;
+    for (k=0; (k < 4) && (status == 0); k++) {
+      p = field[k];
+      while ((status == 0) && (next_token(&p, tok) > 0)) status = add_posting(&ix, tok, i);
+    }
+  }
+  qsort(ix.term, ix.nterm, sizeof(struct term), compare_term);
+
+  fp = open_memstream(&buf, &size);
+  if (fp == NULL) status = -1;
+  if (status == 0) {
+    fprintf(fp, "{\"records\": [");
+    for (i=0; i<s->num; i++) {
+      t = &s->entry[i];
+      fprintf(fp, (i == 0) ? "\n[" : ",\n[");
+      write_json(fp, t->author);
+      fprintf(fp, ", ");
+      write_json(fp, t->year);
+      fprintf(fp, ", ");
+      write_json(fp, t->title);
+      fprintf(fp, ", \"list/page-%d.html#r%016llx\"]", i/s->pagesize + 1,
+              (unsigned long long)t->id);
+    }
+    fprintf(fp, "\n],\n\"terms\": {");
+    for (i=0; i<ix.nterm; i++) {
+      fprintf(fp, (i == 0) ? "\n" : ",\n");
+      write_json(fp, ix.term[i].word);
+      fprintf(fp, ": [%d", ix.term[i].post[0]);
+      for (j=1; j<ix.term[i].npost; j++) fprintf(fp, ",%d", ix.term[i].post[j]-ix.term[i].post[j-1]);
+      fprintf(fp, "]");
+    }
+    fprintf(fp, "\n}}\n");
+  }
+  if (fp != NULL) fclose(fp);
+
+  for (i=0; i<ix.nterm; i++) {
+    free(ix.term[i].word);
+    free(ix.term[i].post);
+  }
+  free(ix.term);
+  free(ix.hash);
+
+  /* Write the index like any other page */
+  sprintf(path, "%s/search.json", s->outdir);
+  if (status == 0) status = write_file(path, buf, size);
+  if ((status == 0) && (s->gz != NULL)) gz_push(s->gz, path, buf, size);
+  else free(buf);
+
+  return status;
+}
+
+
+/* Script of the search page. Every word of the query must start a word
+ * of an entry's author, title, advisor or affiliation, which are split
+ * into words as next_token() does. Terms are looked up by binary search
+ * over their sorted names, and the postings of all terms starting with
+ * a query word are merged before intersecting them with the others */
+const char *search_js =
+  "(function () {\n"
+  "  var MAXSHOWN = 100;\n"
+  "  var q = new URLSearchParams(location.search).get(\"q\") || \"\";\n"
+  "  var out = document.getElementById(\"results\");\n"
+  "\n"
+  "  function words(str) {\n"
+  "    return str.replace(/[A-Z]/g, function (c) { return c.toLowerCase(); })\n"
+  "      .split(/[^a-z0-9\\u0080-\\uffff]+/).filter(function (w) { return w !== \"\"; });\n"
+  "  }\n"
+  "\n"
+  "  function postings(terms, keys, word) {\n"
+  "    var lo = 0, hi = keys.length, mid, found = {}, list, pos, i, j;\n"
+  "    while (lo < hi) {\n"
+  "      mid = (lo + hi) >> 1;\n"
+  "      if (keys[mid] < word) lo = mid + 1; else hi = mid;\n"
+  "    }\n"
+  "    for (i = lo; (i < keys.length) && (keys[i].lastIndexOf(word, 0) === 0); i++) {\n"
+  "      list = terms[keys[i]];\n"
+  "      for (j = 0, pos = 0; j < list.length; j++) {\n"
+  "        pos += list[j];\n"
+  "        found[pos] = true;\n"
+  "      }\n"
+  "    }\n"
+  "    return found;\n"
+  "  }\n"
+  "\n"
+  "  function show(ix) {\n"
+  "    var keys = Object.keys(ix.terms).sort(), w = words(q), hits = null;\n"
+  "    var found, next, li, a, i, k, r;\n"
+  "    for (i = 0; i < w.length; i++) {\n"
+  "      found = postings(ix.terms, keys, w[i]);\n"
+  "      next = [];\n"
+  "      if (hits === null) for (k in found) next.push(+k);\n"
+  "      else for (k = 0; k < hits.length; k++) if (found[hits[k]]) next.push(hits[k]);\n"
+  "      hits = next;\n"
+  "    }\n"
+  "    if (hits === null) return;\n"
+  "    hits.sort(function (x, y) { return x - y; });\n"
+  "    out.appendChild(document.createElement(\"p\")).textContent =\n"
+  "      hits.length + \" found\" + ((hits.length > MAXSHOWN) ? \", showing the first \" + MAXSHOWN : \"\");\n"
+  "    var ul = out.appendChild(document.createElement(\"ul\"));\n"
+  "    for (i = 0; (i < hits.length) && (i < MAXSHOWN); i++) {\n"
+  "      r = ix.records[hits[i]];\n"
+  "      li = ul.appendChild(document.createElement(\"li\"));\n"
+  "      li.appendChild(document.createTextNode(r[0] + \" (\" + r[1] + \") \"));\n"
+  "      a = li.appendChild(document.createElement(\"a\"));\n"
+  "      a.href = r[3];\n"
+  "      a.textContent = r[2];\n"
+  "    }\n"
+  "  }\n"
+  "\n"
+  "  document.getElementById(\"q\").value = q;\n"
+  "  if (words(q).length === 0) return;\n"
+  "  fetch(\"search.json\").then(function (r) { return r.json(); }).then(show, function () {\n"
+  "    out.textContent = \"The search index could not be loaded.\";\n"
+  "  });\n"
+  "})();\n";
+
+
+/* Function to write search.html, a page searching search.json in the
+ * browser, and search.js, its script */
+int write_search(struct site *s) {
+
+  char path[2*STRLEN];
+  char *buf=NULL;
+  size_t size=0;
+  FILE *fp;
+  int status;
+
+  fp = open_memstream(&buf, &size);
+  if (fp == NULL) return -1;
+  write_header(fp, "Search", "");
+  fprintf(fp, "  <form action=\"search.html\">\n");
+  fprintf(fp, "    <input id=\"q\" name=\"q\" size=\"40\"> <input type=\"submit\" value=\"Search\">\n");
+  fprintf(fp, "  </form>\n\n");
+  fprintf(fp, "  <div id=\"results\" align=\"left\" style=\"width:600px;\"></div>\n");
+  fprintf(fp, "  <script src=\"search.js\"></script>\n\n");
+  fprintf(fp, "</div>\n");
+  fprintf(fp, "</body>\n</html>\n");
+  fclose(fp);
+
+  sprintf(path, "%s/search.html", s->outdir);
+  status = write_file(path, buf, size);
+  if ((status == 0) && (s->gz != NULL)) gz_push(s->gz, path, buf, size);
+  else free(buf);
+  if (status != 0) return -1;
+
+  sprintf(path, "%s/search.js", s->outdir);
+  status = write_file(path, search_js, strlen(search_js));
+  if ((status == 0) && (s->gz != NULL)) {
+    buf = strdup(search_js);
+    if (buf == NULL) return -1;
+    gz_push(s->gz, path, buf, strlen(buf));
+  }
+
+  return status;
+}
+
+
+/* Function to write a string as a quoted JSON string */
+void write_json(FILE *fp, const char *str) {
+
+  const unsigned char *p, *span;
+
+  fputc_unlocked('"', fp);
+  for (p=span=(const unsigned char *)str; ; p++) {
+    if ((*p >= 0x20) && (*p != '"') && (*p != '\\')) continue;
+    if (p > span) fwrite_unlocked(span, 1, p-span, fp);
+    if (*p == '\0') break;
+    if ((*p == '"') || (*p == '\\')) {
+      fputc_unlocked('\\', fp);
+      fputc_unlocked(*p, fp);
+    } else {
+      PUT_LIT(fp, "\\u00");
+      fputc_unlocked("0123456789abcdef"[*p >> 4], fp);
+      fputc_unlocked("0123456789abcdef"[*p & 15], fp);
+    }
+    span = p+1;
+  }
+  fputc_unlocked('"', fp);
+}
+
+
+/* Function to set up an io_uring instance with the raw system calls
+ * and map its rings, returning -1 if io_uring is unavailable */
+int uring_init(struct uring *r, unsigned entries) {
+
+  struct io_uring_params p;
+  char *sq, *cq;
+
+  memset(r, 0, sizeof(struct uring));
+  memset(&p, 0, sizeof(p));
+  r->fd = syscall(__NR_io_uring_setup, entries, &p);
+  if (r->fd < 0) return -1;
+
+  r->sq_size = p.sq_off.array + p.sq_entries*sizeof(unsigned);
+  r->cq_size = p.cq_off.cqes + p.cq_entries*sizeof(struct io_uring_cqe);
+  r->sqe_size = p.sq_entries*sizeof(struct io_uring_sqe);
+  r->sq_ring = mmap(NULL, r->sq_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+  r->cq_ring = mmap(NULL, r->cq_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+  r->sqe = mmap(NULL, r->sqe_size, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+  if ((r->sq_ring == MAP_FAILED) || (r->cq_ring == MAP_FAILED) || (r->sqe == MAP_FAILED)) {
+    uring_exit(r);
+    return -1;
+  }
+
+  sq = r->sq_ring;
+  r->sq_head = (unsigned *)(sq + p.sq_off.head);
+  r->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+  r->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+  r->sq_entries = (unsigned *)(sq + p.sq_off.ring_entries);
+  r->sq_array = (unsigned *)(sq + p.sq_off.array);
+  cq = r->cq_ring;
+  r->cq_head = (unsigned *)(cq + p.cq_off.head);
+  r->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+  r->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+  r->cqe = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+
+  return 0;
+}
+
+
+/* Function to return the next free submission queue entry, or NULL if
+ * the submission queue is full */
+struct io_uring_sqe *uring_get(struct uring *r) {
+
+  struct io_uring_sqe *sqe;
+  unsigned tail, idx;
+
+  tail = *r->sq_tail + r->queued;
+  if (tail - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE) >= *r->sq_entries) return NULL;
+
+  idx = tail & *r->sq_mask;
+  sqe = &r->sqe[idx];
+  memset(sqe, 0, sizeof(struct io_uring_sqe));
+  r->sq_array[idx] = idx;
+  r->queued++;
+
+  return sqe;
+}
+
+
+/* Function to submit the queued entries to the kernel, waiting for at
+ * least wait of them to complete */
+int uring_submit(struct uring *r, unsigned wait) {
+
+  unsigned n = r->queued;
+  int ret;
+
+  __atomic_store_n(r->sq_tail, *r->sq_tail + n, __ATOMIC_RELEASE);
+  r->queued = 0;
+
+  do {
+    ret = syscall(__NR_io_uring_enter, r->fd, n, wait,
+                  (wait > 0) ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    n = 0;
+  } while ((ret < 0) && (errno == EINTR));
+
+  return (ret < 0) ? -1 : 0;
+}
+
+
+/* Function to take the next completion from the completion queue,
+ * returning 0 if there is none */
+int uring_reap(struct uring *r, unsigned long long *data, int *res) {
+
+  unsigned head = *r->cq_head;
+  struct io_uring_cqe *cqe;
+
+  if (head == __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE)) return 0;
+
+  cqe = &r->cqe[head & *r->cq_mask];
+  *data = cqe->user_data;
+  *res = cqe->res;
+  __atomic_store_n(r->cq_head, head+1, __ATOMIC_RELEASE);
+
+  return 1;
+}
+
+
+/* Function to ask the kernel whether it supports an operation, returning
+ * 0 if it does not or is too old to answer (before Linux 5.6, which also
+ * lacks IORING_OP_READ, IORING_OP_WRITE and IORING_OP_CLOSE) */
+int uring_probe(struct uring *r, int op) {
+
+  char buf[sizeof(struct io_uring_probe) + 256*sizeof(struct io_uring_probe_op)];
+  struct io_uring_probe *probe = (struct io_uring_probe *)buf;
+
+  memset(buf, 0, sizeof(buf));
+  if (syscall(__NR_io_uring_register, r->fd, IORING_REGISTER_PROBE, probe, 256) < 0) return 0;
+  if (op > probe->last_op) return 0;
+
+  return (probe->ops[op].flags & IO_URING_OP_SUPPORTED) != 0;
+}
+
+
+/* Function to unmap the rings and close the io_uring instance */
+void uring_exit(struct uring *r) {
+
+  if ((r->sq_ring != NULL) && (r->sq_ring != MAP_FAILED)) munmap(r->sq_ring, r->sq_size);
+  if ((r->cq_ring != NULL) && (r->cq_ring != MAP_FAILED)) munmap(r->cq_ring, r->cq_size);
+  if ((r->sqe != NULL) && (r->sqe != MAP_FAILED)) munmap(r->sqe, r->sqe_size);
+  close(r->fd);
+}
+
+
+/* Function to read a whole file into memory, queueing reads of each
+ * block with io_uring if requested. The file is read again with pread
+ * if io_uring is unavailable or any of its reads fails */
+char *read_input(const char *fname, size_t *size, int uring) {
+
+  struct uring ring;
+  struct io_uring_sqe *sqe;
+  struct stat st;
+  size_t off[URING_DEPTH], len[URING_DEPTH];
+  int queued[URING_DEPTH];
+  size_t next=0, done=0;
+  unsigned long long i;
+  char *buf;
+  int fd, res, inflight=0, status=0;
+  ssize_t n;
+
+  fd = open(fname, O_RDONLY);
+  if (fd < 0) return NULL;
+  if ((fstat(fd, &st) != 0) || ((buf = malloc(st.st_size+1)) == NULL)) {
+    close(fd);
+    return NULL;
+  }
+  *size = st.st_size;
+
+  uring = uring && (uring_init(&ring, URING_DEPTH) == 0);
+  if (uring && !uring_probe(&ring, IORING_OP_READ)) {
+    uring_exit(&ring);
+    uring = 0;
+  }
+
+  if (uring) {
+
+    /* Keep every request slot busy with a block read until the whole
+     * file is read, requeueing the rest of any short read */
+    for (i=0; i<URING_DEPTH; i++) len[i] = queued[i] = 0;
+    while ((status == 0) && (done < *size)) {
+      for (i=0; (i < URING_DEPTH) && (next < *size); i++) {
+        if (len[i] > 0) continue;
+        off[i] = next;
+        len[i] = (*size - next < BLOCKSIZE) ? *size - next : BLOCKSIZE;
+        next += len[i];
+      }
+      for (i=0; i<URING_DEPTH; i++) {
+        if ((len[i] == 0) || queued[i]) continue;
+        sqe = uring_get(&ring);
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = fd;
+        sqe->off = off[i];
+        sqe->addr = (unsigned long)(buf + off[i]);
+        sqe->len = len[i];
+        sqe->user_data = i;
+        queued[i] = 1;
+        inflight++;
+      }
+      if (uring_submit(&ring, 1) != 0) break;
+      while (uring_reap(&ring, &i, &res)) {
+        inflight--;
+        queued[i] = 0;
+        if (res <= 0) status = -1;
+        else {
+          off[i] += res;
+          len[i] -= res;
+          done += res;
+        }
+      }
+    }
+
+    /* Wait for any reads still in flight after an error, leaving out
+     * those a failed submission left in the queue */
+    inflight -= *ring.sq_tail - __atomic_load_n(ring.sq_head, __ATOMIC_ACQUIRE);
+    while ((inflight > 0) && (uring_submit(&ring, 1) == 0)) {
+      while (uring_reap(&ring, &i, &res)) inflight--;
+    }
+    uring_exit(&ring);
+  }
+
+  /* Read the file with pread if io_uring did not read all of it */
+  if (done < *size) {
+    done = 0;
+    status = 0;
+    while (done < *size) {
+      n = pread(fd, buf + done, *size - done, done);
+      if (n <= 0) {
+        status = -1;
+        break;
+      }
+      done += n;
+    }
+  }
+
+  close(fd);
+  if (status != 0) {
+    free(buf);
+    return NULL;
+  }
+  buf[*size] = 0;
+
+  return buf;
+}
+
+
+/* Function to write a page to its file with pwrite */
+int write_file(const char *path, const char *buf, size_t size) {
+
+  size_t done=0;
+  ssize_t n;
+  int fd;
+
+  fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) return -1;
+  while (done < size) {
+    n = pwrite(fd, buf + done, size - done, done);
+    if (n <= 0) break;
+    done += n;
+  }
+  if (close(fd) != 0) return -1;
+
+  return (done == size) ? 0 : -1;
+}
+
+
+/* Function to queue a page to be written and closed by the kernel,
+ * waiting for an earlier page to finish if all slots are in use. The
+ * writer takes ownership of the page buffer. The page is still opened
+ * here with open(), as linking an IORING_OP_OPENAT to the write would
+ * need the direct descriptors of Linux 5.15 and later */
+int queue_page(struct writer *w, const char *path, char *buf, size_t size) {
+
+  struct io_uring_sqe *wr, *cl;
+  struct wslot *slot;
+  int i;
+
+  while (w->busy == URING_DEPTH) reap_pages(w, 1);
+  for (i=0; w->slot[i].pending > 0; i++);
+  slot = &w->slot[i];
+
+  slot->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (slot->fd < 0) return -1;
+  strcpy(slot->path, path);
+  slot->buf = buf;
+  slot->size = size;
+  slot->status = 0;
+
+  /* Two entries are free for every slot not in use, so these succeed */
+  wr = uring_get(&w->ring);
+  cl = uring_get(&w->ring);
+  wr->opcode = IORING_OP_WRITE;
+  wr->fd = slot->fd;
+  wr->addr = (unsigned long)buf;
+  wr->len = size;
+  wr->flags = IOSQE_IO_LINK;
+  wr->user_data = 2*i;
+  cl->opcode = IORING_OP_CLOSE;
+  cl->fd = slot->fd;
+  cl->user_data = 2*i+1;
+  slot->pending = 2;
+  w->busy++;
+
+  if (uring_submit(&w->ring, 0) != 0) {
+    /* Neither request reached the kernel */
+    close(slot->fd);
+    slot->pending = 0;
+    w->busy--;
+    return -1;
+  }
+
+  return 0;
+}
+
+
+/* Function to collect completed writes and closes, waiting for at least
+ * wait of them */
+void reap_pages(struct writer *w, unsigned wait) {
+
+  struct wslot *slot;
+  unsigned long long data;
+  int res;
+
+  if (wait > 0) uring_submit(&w->ring, wait);
+  while (uring_reap(&w->ring, &data, &res)) {
+    slot = &w->slot[data/2];
+    if ((data % 2) == 0) {
+      if ((res < 0) || ((size_t)res != slot->size)) slot->status = -1;
+    } else if (res == -ECANCELED) {
+      /* Close was cancelled because the write failed */
+      close(slot->fd);
+    } else if (res < 0) slot->status = -1;
+    if (--slot->pending == 0) finish_page(w, slot);
+  }
+}
+
+
+/* Function to pass a written page on to the compression thread, or count
+ * it as failed */
+void finish_page(struct writer *w, struct wslot *slot) {
+
+  struct site *s = w->s;
+
+  w->busy--;
+  if ((slot->status == 0) && (s->gz != NULL)) gz_push(s->gz, slot->path, slot->buf, slot->size);
+  else free(slot->buf);
+
+  if (slot->status != 0) {
+    pthread_mutex_lock(&s->lock);
+    s->errors++;
+    pthread_mutex_unlock(&s->lock);
+  }
+}
+
+
+/* Function to compress finished pages taken from the queue into .gz
+ * files alongside them until the queue is closed (run on its own thread
+ * so that compression overlaps with rendering) */
+void *gz_thread(void *arg) {
+
+  struct gzqueue *q = (struct gzqueue *)arg;
+  struct gzjob job;
+  char path[2*STRLEN+4];
+  gzFile gz;
+  int status;
+
+  for (;;) {
+    pthread_mutex_lock(&q->lock);
+    while ((q->count == 0) && !q->done) pthread_cond_wait(&q->ready, &q->lock);
+    if (q->count == 0) {
+      pthread_mutex_unlock(&q->lock);
+      break;
+    }
+    job = q->job[q->head];
+    q->head = (q->head + 1) % GZQUEUE;
+    q->count--;
+    pthread_cond_signal(&q->space);
+    pthread_mutex_unlock(&q->lock);
+
+    sprintf(path, "%s.gz", job.path);
+    gz = gzopen(path, "wb9");
+    status = (gz == NULL) ? -1 : 0;
+    if ((status == 0) && (job.size > 0) && (gzwrite(gz, job.buf, job.size) != (int)job.size)) status = -1;
+    if ((gz != NULL) && (gzclose(gz) != Z_OK)) status = -1;
+    free(job.buf);
+
+    if (status != 0) {
+      pthread_mutex_lock(&q->lock);
+      q->errors++;
+      pthread_mutex_unlock(&q->lock);
+    }
+  }
+
+  return NULL;
+}
+
+
+/* Function to start the compression thread */
+int gz_start(struct gzqueue *q) {
+
+  q->head = q->count = q->done = q->errors = 0;
+  pthread_mutex_init(&q->lock, NULL);
+  pthread_cond_init(&q->ready, NULL);
+  pthread_cond_init(&q->space, NULL);
+
+  if (pthread_create(&q->thread, NULL, gz_thread, q) != 0) return -1;
+
+  return 0;
+}
+
+
+/* Function to queue a finished page for compression, waiting while the
+ * queue is full. The queue takes ownership of the page buffer */
+void gz_push(struct gzqueue *q, const char *path, char *buf, size_t size) {
+
+  struct gzjob *job;
+
+  pthread_mutex_lock(&q->lock);
+  while (q->count == GZQUEUE) pthread_cond_wait(&q->space, &q->lock);
+  job = &q->job[(q->head + q->count) % GZQUEUE];
+  strcpy(job->path, path);
+  job->buf = buf;
+  job->size = size;
+  q->count++;
+  pthread_cond_signal(&q->ready);
+  pthread_mutex_unlock(&q->lock);
+}
+
+
+/* Function to close the queue, wait for the remaining pages to be
+ * compressed and return the number that could not be written */
+int gz_finish(struct gzqueue *q) {
+
+  pthread_mutex_lock(&q->lock);
+  q->done = 1;
+  pthread_cond_signal(&q->ready);
+  pthread_mutex_unlock(&q->lock);
+
+  pthread_join(q->thread, NULL);
+  pthread_mutex_destroy(&q->lock);
+  pthread_cond_destroy(&q->ready);
+  pthread_cond_destroy(&q->space);
+
+  return q->errors;
+}
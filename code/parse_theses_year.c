@@ -21,9 +21,30 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <stdint.h>
 
 #define STRLEN 512
 
+/* Literal copies as in parse_theses.c, whose parsing and html writing
+ * functions below are kept the same (check.sh compares them) */
+#define CPY_LIT(p, s) (memcpy(p, s, sizeof(s)-1), (p) += sizeof(s)-1)
+
+/* Longest html table written for one entry: every field escaped to at
+ * most six times its length, plus the fixed fragments */
+#define ENTRYLEN (8*6*STRLEN)
+
+/* Length of the collation key of each entry, and of the part of it
+ * holding the folded author name */
+#define KEYLEN 64
+#define NAMEKEY 44
+
+/* Maximum number of lines kept for each entry */
+#define NSLOT 16
+
+/* Degree types counted in the html summary */
+char *degrees[] = {"MS", "PhD"};
+#define NDEGREE (sizeof(degrees)/sizeof(degrees[0]))
+
 struct thesis {
   char author[STRLEN];
   char year[STRLEN];
@@ -32,11 +53,22 @@ struct thesis {
   char affiliation[STRLEN];
   char degree[STRLEN];
   char url[STRLEN];
+  unsigned char key[KEYLEN];
+  uint64_t id;
 };
 
 
-struct thesis *parse_text(FILE *fp, int *num);
+struct thesis *parse_text(FILE *fp, int *num, int (*keep)(struct thesis *, void *), void *arg);
+int keep_entry(struct thesis *t, void *arg);
+int is_year(const char *line);
+void assign_fields(struct thesis *t, char **line, int n);
+int fold_char(const unsigned char **p, unsigned char *out);
+void make_key(struct thesis *t);
+void make_id(struct thesis *t);
 int compare(const void *s1, const void *s2);
+char *copy_escaped(char *dst, const char *str);
+char *copy_hex(char *dst, uint64_t v);
+void write_entry(FILE *fp, struct thesis *entry);
 int write_html(struct thesis *entry, int num);
 
 
@@ -60,7 +92,7 @@ int main(int argc, char *argv[]) {
   }
 
   /* Parse input text file for information about each thesis/dissertation */
-  entry = parse_text(fp, &num);
+  entry = parse_text(fp, &num, keep_entry, NULL);
 
   /* Close input text file */
   fclose(fp);
@@ -84,51 +116,80 @@ int main(int argc, char *argv[]) {
 
 /* Function to parse a text file and store information about each
  * thesis/dissertation in the appropriate field of a structure and
- * return the number of entries found */
-struct thesis *parse_text(FILE *fp, int *num) {
+ * return the number of entries found. An author line followed by a
+ * year line starts a new entry, so a missing or extra line only
+ * affects the entry it occurs in rather than every later entry. Each
+ * entry is passed to keep, if given, which returns 0 to drop it */
+struct thesis *parse_text(FILE *fp, int *num, int (*keep)(struct thesis *, void *), void *arg) {
 
-  struct thesis *entry=NULL;
-  char line[STRLEN];
-  int i=0, cnt=0;
+  struct thesis *entry=NULL, *grow;
+  char buf[NSLOT][STRLEN];
+  char *line[NSLOT], *tmp;
+  int i, c, n=0, cnt=0, max=0;
+  size_t len;
+
+  for (i=0; i<NSLOT; i++) line[i] = buf[i];
 
   /* Read in each line of text file */
-  while (fgets(line, STRLEN, fp) != NULL) {
-
-    /* Trim \n at end of each line returned by fgets */
-    line[strcspn(line, "\r\n")] = 0;
-
-    /* Assign each line of text file to appropriate field */
-    switch(i) {
-      case 0:
-        if (entry == NULL) entry = malloc(sizeof(struct thesis));
-        else               entry = realloc(entry,sizeof(struct thesis)*(cnt+1));
-
-        strcpy(entry[cnt].author, line);
-        break;
-      case 1:
-        strcpy(entry[cnt].year, line);
-        break;
-      case 2:
-        strcpy(entry[cnt].title, line);
-        break;
-      case 3:
-        strcpy(entry[cnt].advisor, line);
-        break;
-      case 4:
-        strcpy(entry[cnt].affiliation, line);
-        break;
-      case 5:
-        strcpy(entry[cnt].degree, line);
-        break;
-      case 6:
-        strcpy(entry[cnt].url, line);
-        cnt++;
-        break;
+  while (fgets(line[n], STRLEN, fp) != NULL) {
+
+    /* Trim \n at end of each line returned by fgets, discarding the rest
+     * of any line too long for a field rather than reading it as the next */
+    len = strcspn(line[n], "\r\n");
+    if ((line[n][len] == '\0') && (len == STRLEN-1)) {
+      while (((c = fgetc(fp)) != EOF) && (c != '\n'));
+    }
+    line[n][len] = 0;
+
+    /* Skip blank lines before the first field of an entry */
+    if ((n == 0) && (len == 0)) continue;
+
+    /* Store the previous entry when the next author and year are found */
+    if ((n >= 3) && (line[n-1][0] != '\0') && is_year(line[n])) {
+      if (cnt == max) {
+        max = (max == 0) ? 256 : 2*max;
+        grow = realloc(entry, sizeof(struct thesis)*max);
+        if (grow == NULL) {
+          free(entry);
+          *num = -1;
+          return NULL;
+        }
+        entry = grow;
+      }
+      assign_fields(&entry[cnt], line, n-1);
+      if ((keep == NULL) || keep(&entry[cnt], arg)) cnt++;
+
+      tmp = line[0]; line[0] = line[n-1]; line[n-1] = tmp;
+      tmp = line[1]; line[1] = line[n]; line[n] = tmp;
+      n = 2;
+      continue;
+    }
+
+    /* Advance to next line of entry. If an entry has far more lines than
+     * fields the second line of its title is dropped, keeping the fields
+     * after the title and the last lines read, which find the next
+     * author and year */
+    if (n < NSLOT-1) n++;
+    else {
+      tmp = line[3];
+      for (i=3; i<n; i++) line[i] = line[i+1];
+      line[n] = tmp;
     }
+  }
 
-    /* Advance to next field or reset to the beginning for a new entry */
-    i++;
-    if (i == 8) i=0;
+  /* Store the final entry */
+  if (n > 0) {
+    if (cnt == max) {
+      grow = realloc(entry, sizeof(struct thesis)*(max+1));
+      if (grow == NULL) {
+        free(entry);
+        *num = -1;
+        return NULL;
+      }
+      entry = grow;
+    }
+    assign_fields(&entry[cnt], line, n);
+    if ((keep == NULL) || keep(&entry[cnt], arg)) cnt++;
   }
 
   /* Return the number of thesis/dissertation entries read from file */
@@ -138,6 +199,191 @@ struct thesis *parse_text(FILE *fp, int *num) {
 }
 
 
+/* Function to give a parsed entry its sort key and id, keeping every
+ * entry */
+int keep_entry(struct thesis *t, void *arg) {
+
+  (void)arg;
+  make_key(t);
+  make_id(t);
+
+  return 1;
+}
+
+
+/* Function to fold the character at *p to lowercase ASCII without
+ * diacritics, storing it in out and returning the number of bytes
+ * stored (0 for punctuation), and leaving *p at its last byte. Other
+ * UTF-8 characters are kept byte by byte, after all ASCII letters */
+int fold_char(const unsigned char **p, unsigned char *out) {
+
+  const char *latin1 = "aaaaaaaceeeeiiiidnooooo\0ouuuuyts"
+                       "aaaaaaaceeeeiiiidnooooo\0ouuuuyty";
+  const char *latinA = "aaaaaaccccccccddddeeeeeeeeeegggggggghhhhiiiiiiiiiiiijjkkk"
+                       "llllllllllnnnnnnnnnoooooooorrrrrrssssssssttttttuuuuuuuuuuuu"
+                       "wwyyyzzzzzzs";
+  const unsigned char *c = *p;
+
+  if (isalnum(c[0])) {
+    out[0] = tolower(c[0]);
+    return 1;
+  }
+
+  /* Two-byte sequences C3 80 to C3 BF cover À to ÿ, and C4 80 to C5 BF
+   * cover Ā to ſ */
+  if ((c[0] == 0xC3) && (c[1] >= 0x80) && (c[1] <= 0xBF)) {
+    (*p)++;
+    out[0] = latin1[c[1] - 0x80];
+    return (out[0] != 0);
+  }
+  if (((c[0] == 0xC4) || (c[0] == 0xC5)) && (c[1] >= 0x80) && (c[1] <= 0xBF)) {
+    (*p)++;
+    out[0] = latinA[((c[0] - 0xC4) << 6) | (c[1] - 0x80)];
+    return 1;
+  }
+
+  if (c[0] >= 0x80) {
+    out[0] = c[0];
+    return 1;
+  }
+
+  return 0;
+}
+
+
+/* Function to build the collation key of an entry once, so that sorting
+ * only needs memcmp(). The key holds the author's last name and then
+ * first names with case and diacritics folded, ignoring spaces and
+ * punctuation so that name particles sort the same however they are
+ * written (eg, "de Larquier" and "DeLarquier"), and with "St." and
+ * "Ste." spelled out. It is padded to NAMEKEY bytes and followed by
+ * the year and then the raw author, which only break ties */
+void make_key(struct thesis *t) {
+
+  unsigned char *key = t->key;
+  const unsigned char *p = (const unsigned char *)t->author;
+  int n=0, word=1, comma=0;
+
+  memset(key, 0, KEYLEN);
+  for (; (*p != '\0') && (n < NAMEKEY); p++) {
+
+    /* Separate the last name from the first names with a byte that
+     * sorts before any letter */
+    if ((*p == ',') && !comma) {
+      key[n++] = 1;
+      comma = word = 1;
+      continue;
+    }
+
+    if (word && (tolower(p[0]) == 's') && (p[1] == 't') &&
+        ((p[2] == '.') || (p[2] == ' ') || ((p[2] == 'e') && (p[3] == '.')))) {
+      strncpy((char *)key+n, (p[2] == 'e') ? "sainte" : "saint", NAMEKEY-n);
+      n += (p[2] == 'e') ? 6 : 5;
+      p += (p[2] == 'e') ? 2 : 1;
+      if (n > NAMEKEY) n = NAMEKEY;
+      continue;
+    }
+
+    word = (isspace(*p) || (*p == '.') || (*p == '-') || (*p == '\''));
+    n += fold_char(&p, key+n);
+  }
+
+  memcpy(key+NAMEKEY, t->year, strnlen(t->year, 4));
+  memcpy(key+NAMEKEY+4, t->author, strnlen(t->author, KEYLEN-NAMEKEY-4));
+}
+
+
+/* Function to compute the ID of an entry once, as a 64-bit FNV-1a hash
+ * of its author, year and title with case, diacritics, spaces and
+ * punctuation folded away, so that it is kept through small changes in
+ * how they are written. Characters fold_char() cannot fold to ASCII
+ * (eg, Greek, Cyrillic or CJK text, or signs such as ×) are hashed as
+ * their UTF-8 bytes, so that they still tell entries apart. It names
+ * the anchor of the entry in the html and identifies the entry across
+ * catalogues and edits */
+void make_id(struct thesis *t) {
+
+  const char *field[3];
+  const unsigned char *p, *q;
+  unsigned char c;
+  uint64_t h = 14695981039346656037ULL;
+  int i;
+
+  field[0] = t->author;
+  field[1] = t->year;
+  field[2] = t->title;
+  for (i=0; i<3; i++) {
+    for (p=(const unsigned char *)field[i]; *p != '\0'; p++) {
+      q = p;
+      if (fold_char(&p, &c) && (c < 0x80)) h = (h ^ c) * 1099511628211ULL;
+      else if (*q >= 0x80) {
+        h = (h ^ *q++) * 1099511628211ULL;
+        while ((*q & 0xC0) == 0x80) h = (h ^ *q++) * 1099511628211ULL;
+        p = q-1;
+      }
+    }
+    h = (h ^ '\n') * 1099511628211ULL;
+  }
+
+  t->id = h;
+}
+
+
+/* Function to check whether a line holds a four-digit year */
+int is_year(const char *line) {
+  return isdigit((unsigned char)line[0]) && isdigit((unsigned char)line[1]) &&
+         isdigit((unsigned char)line[2]) && isdigit((unsigned char)line[3]) &&
+         (line[4] == '\0');
+}
+
+
+/* Function to assign the n lines of an entry to the fields of a structure.
+ * Well-formed entries have seven lines (eight with the blank separator),
+ * while shorter or longer entries are assigned by rule: a trailing line
+ * starting with "http" is the URL, a known degree type is the degree,
+ * extra lines after the title are joined to it (eg, a wrapped title), and
+ * a lone line between the title and degree is taken to be the affiliation
+ * if it contains a comma but no "&" and the advisor otherwise */
+void assign_fields(struct thesis *t, char **line, int n) {
+
+  int i, m;
+  char **f;
+
+  /* Strip trailing blank lines, which are separators or empty fields */
+  while ((n > 2) && (line[n-1][0] == '\0')) n--;
+
+  strcpy(t->author, line[0]);
+  strcpy(t->year, (n > 1) ? line[1] : "");
+  t->title[0] = t->advisor[0] = t->affiliation[0] = t->degree[0] = t->url[0] = 0;
+
+  f = line+2;
+  m = n-2;
+  if (m <= 0) return;
+
+  if ((strncmp(f[m-1], "http", 4) == 0) || (m == 5)) strcpy(t->url, f[--m]);
+  if (m == 0) return;
+
+  for (i=0; i<(int)NDEGREE; i++) if (strcmp(f[m-1], degrees[i]) == 0) break;
+  if ((i < (int)NDEGREE) || (m == 4)) strcpy(t->degree, f[--m]);
+
+  strcpy(t->title, f[0]);
+  if (m > 3) {
+    for (i=1; i<m-2; i++) {
+      strncat(t->title, " ", STRLEN-strlen(t->title)-1);
+      strncat(t->title, f[i], STRLEN-strlen(t->title)-1);
+    }
+    strcpy(t->advisor, f[m-2]);
+    strcpy(t->affiliation, f[m-1]);
+  } else if (m == 3) {
+    strcpy(t->advisor, f[1]);
+    strcpy(t->affiliation, f[2]);
+  } else if (m == 2) {
+    if ((strchr(f[1], ',') != NULL) && (strchr(f[1], '&') == NULL)) strcpy(t->affiliation, f[1]);
+    else strcpy(t->advisor, f[1]);
+  }
+}
+
+
 /* Function to sort theses/dissertations first by year and
  * then by author last name (for use with qsort) */
 int compare(const void *s1, const void *s2) {
@@ -147,19 +393,83 @@ int compare(const void *s1, const void *s2) {
   int yearcompare = strcmp(t2->year, t1->year);
 
   if (yearcompare == 0) {
-    /* Make sure first letter in author field is capitalized */
-    char author1[STRLEN], author2[STRLEN];
-    strcpy(author1, t1->author);
-    strcpy(author2, t2->author);
-    author1[0] = toupper(author1[0]);
-    author2[0] = toupper(author2[0]);
+    return memcmp(t1->key, t2->key, KEYLEN);
+  } else {
+    return yearcompare;
+  }
+}
+
+
+/* Function to copy a string into dst with the html special characters
+ * replaced by entities, returning the end of the copy */
+char *copy_escaped(char *dst, const char *str) {
+
+  size_t n;
+
+  while (*str != '\0') {
+    n = strcspn(str, "&<>\"'");
+    memcpy(dst, str, n);
+    dst += n;
+    str += n;
+
+    switch (*str) {
+      case '&':  CPY_LIT(dst, "&amp;"); break;
+      case '<':  CPY_LIT(dst, "&lt;"); break;
+      case '>':  CPY_LIT(dst, "&gt;"); break;
+      case '"':  CPY_LIT(dst, "&quot;"); break;
+      case '\'': CPY_LIT(dst, "&#39;"); break;
+      default:   return dst;
+    }
+    str++;
+  }
+  return dst;
+}
+
+
+/* Function to copy a 64-bit ID into dst as 16 hex digits, returning
+ * the end of the copy */
+char *copy_hex(char *dst, uint64_t v) {
+
+  int i;
+
+  for (i=15; i>=0; i--) {
+    dst[i] = "0123456789abcdef"[v & 15];
+    v >>= 4;
+  }
+  return dst+16;
+}
 
-    int authorcompare = strcmp(author1, author2);
 
-    return authorcompare;
+/* Function to write the html table for one thesis/dissertation. The
+ * table is built in a local buffer from literals of known length and
+ * the escaped fields, then written with a single call */
+void write_entry(FILE *fp, struct thesis *entry) {
+
+  char buf[ENTRYLEN], *p = buf;
+
+  CPY_LIT(p, "  <a name=r");
+  p = copy_hex(p, entry->id);
+  CPY_LIT(p, "></a>\n  <table style=\"border:1px solid black; width:600px;\">\n"
+             "    <tr><td><b>Author:</b> ");
+  p = copy_escaped(p, entry->author);
+  CPY_LIT(p, "</td></tr>\n    <tr><td><b>Year:</b> ");
+  p = copy_escaped(p, entry->year);
+  CPY_LIT(p, "</td></tr>\n    <tr><td><b>Title:</b> ");
+  p = copy_escaped(p, entry->title);
+  CPY_LIT(p, "</td></tr>\n    <tr><td><b>Advisor:</b> ");
+  p = copy_escaped(p, entry->advisor);
+  CPY_LIT(p, "</td></tr>\n    <tr><td><b>Affiliation:</b> ");
+  p = copy_escaped(p, entry->affiliation);
+  CPY_LIT(p, "</td></tr>\n    <tr><td><b>Degree:</b> ");
+  p = copy_escaped(p, entry->degree);
+  if (entry->url[0] == '\0') {
+    CPY_LIT(p, "</td></tr>\n  </table><br>\n\n");
   } else {
-    return yearcompare;
+    CPY_LIT(p, "</td><td align=\"right\"><a href=\"");
+    p = copy_escaped(p, entry->url);
+    CPY_LIT(p, "\" target=\"_blank\">URL</a></td></tr>\n  </table><br>\n\n");
   }
+  fwrite_unlocked(buf, 1, p-buf, fp);
 }
 
 
@@ -211,19 +521,7 @@ int write_html(struct thesis *entry, int num) {
     }
 
     /* Build html table for each thesis/dissertation */
-    fprintf(stdout, "  <table style=\"border:1px solid black; width:600px;\">\n");
-    fprintf(stdout, "    <tr><td><b>Author:</b> %s</td></tr>\n", entry[i].author);
-    fprintf(stdout, "    <tr><td><b>Year:</b> %s</td></tr>\n", entry[i].year);
-    fprintf(stdout, "    <tr><td><b>Title:</b> %s</td></tr>\n", entry[i].title);
-    fprintf(stdout, "    <tr><td><b>Advisor:</b> %s</td></tr>\n", entry[i].advisor);
-    fprintf(stdout, "    <tr><td><b>Affiliation:</b> %s</td></tr>\n", entry[i].affiliation);
-    fprintf(stdout, "    <tr><td><b>Degree:</b> %s</td>", entry[i].degree);
-    if (entry[i].url[0] == '\0') {
-      fprintf(stdout,"</tr>\n");
-    } else {
-      fprintf(stdout, "<td align=\"right\"><a href=\"%s\" target=\"_blank\">URL</a></td></tr>\n", entry[i].url);
-    }
-    fprintf(stdout, "  </table><br>\n\n");
+    write_entry(stdout, &entry[i]);
   }
 
   /* Print total number of items at bottom of page */